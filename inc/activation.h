@@ -0,0 +1,30 @@
+/**
+ * @file activation.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef ACTIVATION_H_INCLUDED
+#define ACTIVATION_H_INCLUDED
+
+#include <stdint.h>
+
+/**
+ * @brief First file descriptor passed to socket activated service
+ * 
+ */
+#define ACTIVATION_FDS_START 3
+
+/**
+ * @brief Permissions of unix listening sockets
+ * 
+ */
+#define ACTIVATION_UNIX_MODE 0666
+
+uint8_t activation_validate(const char* spec);
+int activation_open(const char* spec);
+
+#endif
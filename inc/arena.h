@@ -0,0 +1,49 @@
+/**
+ * @file arena.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+#include <stdalign.h>
+#include <stddef.h>
+
+/**
+ * @brief Minimum size of a block allocated by the arena [bytes]
+ * 
+ */
+#define ARENA_BLOCKSIZE 4096
+
+/**
+ * @brief Block of memory from which allocations are cut
+ * 
+ */
+struct arena_block {
+    struct arena_block* next;
+    size_t size;
+    size_t used;
+    alignas(max_align_t) char data[];  // aligned for any allocation
+};
+
+/**
+ * @brief Bump allocator, everything allocated from it is freed at once
+ * 
+ */
+struct arena {
+    /**
+     * @brief Block which is allocated from, older blocks follow it
+     * 
+     */
+    struct arena_block* head;
+};
+
+void arena_init(struct arena* a);
+void* arena_alloc(struct arena* a, size_t size);
+char* arena_strdup(struct arena* a, const char* str);
+void arena_free(struct arena* a);
+#endif
@@ -0,0 +1,44 @@
+/**
+ * @file batch.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef BATCH_H_INCLUDED
+#define BATCH_H_INCLUDED
+#include <stdint.h>
+#include <unistd.h>
+
+#include "process.h"
+
+/**
+ * @brief Shell which runs batched scripts, it reads commands from stdin
+ * 
+ */
+#define BATCH_SHELL "/bin/sh -s"
+
+/**
+ * @brief Maximum number of scripts running in the batch shell at once
+ * 
+ */
+#define BATCH_MAXJOBS 128
+
+/**
+ * @brief Maximum length of a line reported by the batch shell
+ * 
+ */
+#define BATCH_REPORTLEN 64
+
+/**
+ * @brief Callback notifying the owner of a batched script of its PID
+ * 
+ */
+typedef void (*batch_startedCallback)(void *owner, pid_t pid);
+
+uint8_t batch_submit(const char *script, const char *arg, const char *procs, batch_startedCallback started, process_exitCallback exited, void *owner);
+void batch_cancel(void *owner);
+
+#endif
@@ -0,0 +1,39 @@
+/**
+ * @file cgroup.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef CGROUP_H_INCLUDED
+#define CGROUP_H_INCLUDED
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * @brief Mountpoint of the cgroup v2 hierarchy
+ * 
+ */
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+/**
+ * @brief Mountpoint of the cgroup v2 hierarchy when v1 hierarchies are on CGROUP_ROOT
+ * 
+ */
+#define CGROUP_UNIFIED CGROUP_ROOT "/unified"
+
+/**
+ * @brief Group under the cgroup of init which holds groups of services
+ * 
+ */
+#define CGROUP_NAME "quickinit"
+
+uint8_t cgroup_init();
+const char* cgroup_create(const char* name);
+void cgroup_join(const char* procs);
+uint8_t cgroup_freeze(const char* name, uint8_t freeze);
+uint8_t cgroup_populated(const char* name);
+
+#endif
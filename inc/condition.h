@@ -0,0 +1,52 @@
+/**
+ * @file condition.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef CONDITION_H_INCLUDED
+#define CONDITION_H_INCLUDED
+
+#include <stdint.h>
+
+/*! \cond PRIVATE */
+#define CONDITION_PATH_EXISTS 0
+#define CONDITION_MOUNTPOINT 1
+#define CONDITION_KERNEL_CMDLINE 2
+#define CONDITION_FILE_NOT_EMPTY 3
+#define CONDITION_VIRTUALIZATION 4
+/*! \endcond */
+
+/**
+ * @brief Condition which must be true, otherwise the service isn't spawned
+ * 
+ */
+struct condition {
+    /**
+     * @brief CONDITION_* type
+     * 
+     */
+    uint8_t type;
+
+    /**
+     * @brief 1 if the condition must be false, written as !value
+     * 
+     */
+    uint8_t negate;
+
+    /**
+     * @brief Path, cmdline parameter or virtualization type
+     * 
+     */
+    char* arg;
+};
+
+uint8_t condition_parse(uint8_t type, const char* value, struct condition* out);
+uint8_t condition_check(const struct condition* c);
+const char* condition_name(uint8_t type);
+uint8_t condition_isContainer();
+
+#endif
@@ -23,6 +23,108 @@
  */
 #define DISABLE_CAD 0
 
+/**
+ * @brief Runlevel entered at boot, can be overriden with quickinit.runlevel= on kernel cmdline
+ * 
+ */
+#define DEFAULT_RUNLEVEL 3
+
+/**
+ * @brief Start ttys without waiting for services, 1 if you want to
+ * Only services with before_console=yes are waited for. Can be overriden with quickinit.early_console= on kernel cmdline.
+ */
+#define EARLY_CONSOLE 0
+
+/**
+ * @brief Write trace events to the kernel trace_marker, 1 if you want to
+ * USDT probes don't need it. Can be overriden with quickinit.trace= on kernel cmdline.
+ */
+#define TRACE_MARKER 0
+
+/**
+ * @brief Shell spawned on MSG_CONSOLE when a service with on_timeout=emergency times out
+ * 
+ */
+#define EMERGENCY_SHELL "/bin/sh"
+
+/**
+ * @brief Detect container and run in container mode, 0 if you want to use only --container argument
+ * 
+ */
+#define CONTAINER_DETECT 1
+
+/**
+ * @brief Time in which services must be stopped in container mode, including their stop scripts, then they are killed [seconds]
+ * 
+ */
+#define CONTAINER_STOP_TIMEOUT 8
+
+/**
+ * @brief Part of CONTAINER_STOP_TIMEOUT which stop scripts can't use, processes have it to exit after SIGTERM [seconds]
+ * 
+ */
+#define CONTAINER_TERM_TIMEOUT 2
+
+/**
+ * @brief Directory for runtime files of the init
+ * 
+ */
+#define RUN_DIR "/run/quickinit"
+
+/**
+ * @brief Directory for files kept across boots
+ * 
+ */
+#define STATE_DIR "/var/lib/quickinit"
+
+/**
+ * @brief Start durations of services learned in previous boots, see history.h
+ * 
+ */
+#define HISTORY_FILE STATE_DIR "/durations"
+
+/**
+ * @brief Maximum number of start scripts running at once, 0 for no limit
+ * Can be overriden with quickinit.jobs= on kernel cmdline.
+ */
+#define JOB_SLOTS 0
+
+/**
+ * @brief Unix socket serving metrics in Prometheus text format
+ * 
+ */
+#define METRICS_SOCKET RUN_DIR "/metrics"
+
+/**
+ * @brief Unix socket for requests of telinit which init answers later, see control.h
+ * 
+ */
+#define CONTROL_SOCKET RUN_DIR "/control"
+
+/**
+ * @brief Shared memory page with status of services and ttys, see status.h
+ * 
+ */
+#define STATUS_FILE RUN_DIR "/state"
+
+/**
+ * @brief Boot timeline with durations and resource usage of services
+ * 
+ */
+#define TIMELINE_FILE RUN_DIR "/timeline"
+
+/**
+ * @brief Events of the boot passed to init executed from initramfs
+ * 
+ */
+#define TIMELINE_HANDOFF RUN_DIR "/timeline.handoff"
+
+/**
+ * @brief Flight recorder with recent events of init
+ * 
+ */
+#define RECORDER_FILE RUN_DIR "/recorder"
+
 // Uncomment the line below if you want to print debug messages
 //#define DEBUG
 #endif
@@ -60,6 +60,7 @@
  */
 #define COLOR_WHT "\x1B[37m"
 
+void console_useStdout();
 uint8_t console_print(const char* text, ...);
 uint8_t console_error(const char* text, ...);
 uint8_t console_info(const char* text, ...);
@@ -0,0 +1,65 @@
+/**
+ * @file control.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef CONTROL_H_INCLUDED
+#define CONTROL_H_INCLUDED
+
+/**
+ * @brief Maximum size of a request or reply, every one is one SOCK_SEQPACKET message
+ * 
+ */
+#define CONTROL_MAXMSG 256
+
+/**
+ * @brief Maximum number of connected clients
+ * 
+ */
+#define CONTROL_MAXCLIENTS 64
+
+/**
+ * @brief Request which is answered when boot is finished
+ * 
+ */
+#define CONTROL_WAIT_BOOT "wait boot-complete"
+
+/**
+ * @brief Request which is answered when the service is up, followed by its name
+ * 
+ */
+#define CONTROL_WAIT_SERVICE "wait service "
+
+/**
+ * @brief Request which freezes the service or group, followed by its name
+ * 
+ */
+#define CONTROL_FREEZE "freeze "
+
+/**
+ * @brief Request which thaws the service or group, followed by its name
+ * 
+ */
+#define CONTROL_THAW "thaw "
+
+/**
+ * @brief Reply to a satisfied request
+ * 
+ */
+#define CONTROL_OK "ok"
+
+/**
+ * @brief Prefix of reply to a request which can't be satisfied, followed by the reason
+ * 
+ */
+#define CONTROL_FAILED "failed "
+
+void control_init();
+void control_bootComplete();
+void control_serviceChanged(const char *name);
+
+#endif
@@ -0,0 +1,41 @@
+/**
+ * @file history.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef HISTORY_H_INCLUDED
+#define HISTORY_H_INCLUDED
+
+/**
+ * @brief Maximum number of services whose start durations are remembered
+ * 
+ */
+#define HISTORY_MAXENTRIES 1024
+
+/**
+ * @brief Magic number at the start of HISTORY_FILE
+ * 
+ */
+#define HISTORY_MAGIC 0x68736971
+
+/**
+ * @brief Version of HISTORY_FILE layout, files with other versions are ignored
+ * 
+ */
+#define HISTORY_VERSION 2
+
+/**
+ * @brief Weight of the last start in the learned duration, older starts fade out
+ * 
+ */
+#define HISTORY_WEIGHT 0.5
+
+void history_load();
+double history_get(const char* name);
+void history_record(const char* name, double seconds);
+void history_save();
+#endif
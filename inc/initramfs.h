@@ -0,0 +1,35 @@
+/**
+ * @file initramfs.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef INITRAMFS_H_INCLUDED
+#define INITRAMFS_H_INCLUDED
+#include <stdint.h>
+
+/**
+ * @brief Directory in the initramfs on which the real root is mounted
+ * 
+ */
+#define INITRAMFS_NEWROOT "/sysroot"
+
+/**
+ * @brief Time for the root device to appear [seconds]
+ * 
+ */
+#define INITRAMFS_ROOT_TIMEOUT 30
+
+/**
+ * @brief Init executed in the real root, init= on the kernel command line overrides it
+ * 
+ */
+#define INITRAMFS_INIT "/sbin/init"
+
+uint8_t initramfs_isActive();
+void initramfs_switchRoot(char* argv[]);
+
+#endif
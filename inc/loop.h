@@ -0,0 +1,63 @@
+/**
+ * @file loop.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef LOOP_H_INCLUDED
+#define LOOP_H_INCLUDED
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+/**
+ * @brief Interval of the periodic tick [miliseconds]
+ * 
+ */
+#define LOOP_TICK_MS 1000
+
+/**
+ * @brief Maximum number of events handled in one pass
+ * 
+ */
+#define LOOP_MAXEVENTS 32
+
+/**
+ * @brief Resolution of timers [miliseconds]
+ * 
+ */
+#define LOOP_WHEEL_RES_MS 10
+
+/*! \cond PRIVATE */
+#define LOOP_WHEEL_BITS 6
+#define LOOP_WHEEL_SIZE (1 << LOOP_WHEEL_BITS)
+#define LOOP_WHEEL_LEVELS 4
+/*! \endcond */
+
+/**
+ * @brief Callback called when a watched descriptor is ready
+ * 
+ */
+typedef void (*loop_callback)(int fd, uint32_t events, void* data);
+
+/**
+ * @brief Callback called when a timer expires, the timer is freed after it returns
+ * 
+ */
+typedef void (*loop_timerCallback)(void* data);
+
+struct loop_timer;
+
+void loop_init();
+uint8_t loop_addFd(int fd, uint32_t events, loop_callback cb, void* data);
+void loop_removeFd(int fd);
+void loop_addTick(void (*tick)());
+struct loop_timer* loop_addTimer(double seconds, loop_timerCallback cb, void* data);
+void loop_cancelTimer(struct loop_timer* timer);
+void loop_runOnce();
+void loop_run();
+
+#endif
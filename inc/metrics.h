@@ -0,0 +1,40 @@
+/**
+ * @file metrics.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef METRICS_H_INCLUDED
+#define METRICS_H_INCLUDED
+
+/*! \cond PRIVATE */
+#define METRICS_SPAWNS 0
+#define METRICS_EXEC_FAILURES 1
+#define METRICS_REAPS 2
+#define METRICS_TTY_RESPAWNS 3
+#define METRICS_BACKOFFS 4
+#define METRICS_CONSOLE_DROPPED 5
+#define METRICS_SVC_TIMEOUTS 6
+#define METRICS_HEALTH_FAILURES 7
+#define METRICS_JOB_RUNS 8
+#define METRICS_COUNTERS 9
+
+#define METRICS_SVC_START 0
+#define METRICS_SVC_STOP 1
+#define METRICS_HISTOGRAMS 2
+
+#define METRICS_PHASE_MOUNT 0
+#define METRICS_PHASE_SERVICES 1
+#define METRICS_PHASE_TTYS 2
+#define METRICS_PHASES 3
+/*! \endcond */
+
+void metrics_init();
+void metrics_inc(unsigned int counter);
+void metrics_observe(unsigned int histogram, double seconds);
+void metrics_setPhase(unsigned int phase, double seconds);
+
+#endif
@@ -9,10 +9,192 @@
  */
 #ifndef PROCESS_H_INCLUDED
 #define PROCESS_H_INCLUDED
+#include <stdint.h>
+#include <sys/resource.h>
 #include <unistd.h>
+
+#include "arena.h"
+#include "topology.h"
+
+/**
+ * @brief Exit code of a child which failed to exec its program
+ * 
+ */
+#define PROCESS_EXEC_FAILED 127
+
+/**
+ * @brief Maximum number of children reaped before their owners are notified
+ * 
+ */
+#define PROCESS_REAP_BATCH 64
+
+/**
+ * @brief Initial size of the PID to owner table, must be a power of two
+ * 
+ */
+#define PROCESS_TABLE_MINSIZE 64
+
+/**
+ * @brief Interval of polling a child with timeout when kernel doesn't have pidfd [microseconds]
+ * 
+ */
+#define PROCESS_WAIT_POLL_US 10000
+
+/**
+ * @brief Exit information of a reaped child
+ * 
+ */
+struct process_exit {
+    /**
+     * @brief PID of the child
+     * 
+     */
+    pid_t pid;
+
+    /**
+     * @brief Exit code, -1 if the child was killed by a signal
+     * 
+     */
+    int code;
+
+    /**
+     * @brief Signal which killed the child, otherwise 0
+     * 
+     */
+    int signal;
+
+    /**
+     * @brief Resources used by the child
+     * 
+     */
+    struct rusage usage;
+};
+
+/**
+ * @brief Resources used by all runs of a program, accumulated from exits
+ * 
+ */
+struct process_usage {
+    /**
+     * @brief User CPU time [seconds]
+     * 
+     */
+    double user;
+
+    /**
+     * @brief System CPU time [seconds]
+     * 
+     */
+    double sys;
+
+    /**
+     * @brief Time between spawn and exit [seconds]
+     * 
+     */
+    double wall;
+
+    /**
+     * @brief Maximum resident set size of any run [kilobytes]
+     * 
+     */
+    long maxrss;
+
+    /**
+     * @brief Major page faults
+     * 
+     */
+    long majflt;
+
+    /**
+     * @brief Voluntary context switches
+     * 
+     */
+    long nvcsw;
+
+    /**
+     * @brief Involuntary context switches
+     * 
+     */
+    long nivcsw;
+
+    /**
+     * @brief Number of runs
+     * 
+     */
+    uint32_t runs;
+};
+
+/**
+ * @brief Everything needed to spawn a program, built once when configuration is loaded
+ * 
+ */
+struct process_plan {
+    /**
+     * @brief Resolved path of the executable, NULL if the plan is empty
+     * 
+     */
+    const char *path;
+
+    /**
+     * @brief Arguments, NULL terminated
+     * 
+     */
+    char **argv;
+
+    /**
+     * @brief Environment, NULL terminated
+     * 
+     */
+    char **envp;
+
+    /**
+     * @brief Number of entries in envp
+     * 
+     */
+    uint8_t envc;
+
+    /**
+     * @brief Device to which stdin, stdout and stderr are redirected
+     * 
+     */
+    const char *stdio;
+
+    /**
+     * @brief 1 if stdio is a tty which becomes the controlling terminal
+     * 
+     */
+    uint8_t is_tty;
+
+    /**
+     * @brief CPUs to which the program is pinned, NULL if it runs where init does
+     * 
+     */
+    const struct topology_cpus *affinity;
+
+    /**
+     * @brief Path of cgroup.procs of the cgroup which the program joins, NULL if it stays in the cgroup of init
+     * 
+     */
+    const char *cgroup;
+};
+
+/**
+ * @brief Callback notifying the owner of a child that it has exited
+ * 
+ */
+typedef void (*process_exitCallback)(void *owner, const struct process_exit *ex);
+
 void process_killEverything();
-int process_spawnChildren();
-pid_t process_execute(char *prog);
-pid_t process_executeTty(char *prog, int tty);
+void process_inheritStdio();
+uint8_t process_buildPlan(struct arena *a, struct process_plan *plan, const char *cmd, const char *tty);
+uint8_t process_addEnv(struct arena *a, struct process_plan *plan, const char *entry);
+pid_t process_spawn(const struct process_plan *plan);
+pid_t process_spawnWithFds(const struct process_plan *plan, const int *fds, uint8_t nfds);
+pid_t process_spawnPiped(const struct process_plan *plan, int in, int out);
+void process_watch(pid_t pid, process_exitCallback cb, void *owner);
+void process_unwatch(pid_t pid);
+void process_reap();
+uint8_t process_waitFor(pid_t pid, struct process_exit *ex, double timeout);
+void process_addUsage(struct process_usage *total, const struct process_exit *ex, double wall);
 
 #endif
@@ -0,0 +1,280 @@
+/**
+ * @file recorder.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef RECORDER_H_INCLUDED
+#define RECORDER_H_INCLUDED
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Identifies the flight recorder, "qirc" in little endian
+ * 
+ */
+#define RECORDER_MAGIC 0x63726971
+
+/**
+ * @brief Version of the recorder layout, changed when entries or events change
+ * 
+ */
+#define RECORDER_VERSION 2
+
+/**
+ * @brief Number of events kept, older ones are overwritten, must be a power of two
+ * 
+ */
+#define RECORDER_ENTRIES 512
+
+/**
+ * @brief Maximum number of arguments of an event
+ * 
+ */
+#define RECORDER_VALUES 3
+
+/**
+ * @brief Space for string arguments of an event, longer ones are truncated
+ * 
+ */
+#define RECORDER_TEXTLEN 64
+
+/**
+ * @brief How many times a reader copies an entry which is being written before it gives up
+ * 
+ */
+#define RECORDER_RETRIES 64
+
+/**
+ * @brief Size of the stack on which the crash handler runs, the normal one may be what crashed
+ * 
+ */
+#define RECORDER_ALTSTACK 65536
+
+/**
+ * @brief Kernel log, the crash dump goes there and so to the console and pstore
+ * 
+ */
+#define RECORDER_KMSG "/dev/kmsg"
+
+/*! \cond PRIVATE */
+#define RECORDER_FMT_spawn "pid=%d path=%s"
+#define RECORDER_FMT_exec "pid=%d path=%s"
+#define RECORDER_FMT_reap "pid=%d code=%d signal=%d"
+#define RECORDER_FMT_respawn "service=%s restarts=%u"
+#define RECORDER_FMT_respawn_tty "tty=%s pid=%d"
+#define RECORDER_FMT_state "service=%s state=%d pid=%d"
+#define RECORDER_FMT_shutdown "phase=%s code=%d"
+#define RECORDER_FMT_switch_root "device=%s init=%s"
+/*! \endcond */
+
+/**
+ * @brief Events which can be recorded, their arguments are formatted by RECORDER_FMT_name when they're read
+ * New events are appended, so numbers of the old ones don't change.
+ */
+#define RECORDER_EVENTS(X) \
+    X(spawn)               \
+    X(exec)                \
+    X(reap)                \
+    X(respawn)             \
+    X(respawn_tty)         \
+    X(state)               \
+    X(shutdown)            \
+    X(switch_root)
+
+/*! \cond PRIVATE */
+#define RECORDER_ENUM(name) RECORDER_EVENT_##name,
+/*! \endcond */
+
+enum recorder_event { RECORDER_EVENTS(RECORDER_ENUM) RECORDER_EVENT_COUNT };
+
+/**
+ * @brief Header at the beginning of the recorder
+ * 
+ */
+struct recorder_header {
+    uint32_t magic;
+    uint32_t version;
+
+    /**
+     * @brief Size of struct recorder_entry and number of entries, so readers can check the layout
+     * 
+     */
+    uint32_t entry_size;
+    uint32_t capacity;
+
+    /**
+     * @brief Number of events recorded, event n is in entry n % capacity, which is claimed before it is written
+     * 
+     */
+    uint64_t head;
+};
+
+/**
+ * @brief Recorded event
+ * Fields are valid only if seq was even and didn't change while they were copied.
+ */
+struct recorder_entry {
+    /**
+     * @brief Sequence counter, odd while init is writing the entry
+     * 
+     */
+    uint32_t seq;
+
+    /**
+     * @brief RECORDER_EVENT_*
+     * 
+     */
+    uint16_t event;
+    uint16_t reserved;
+
+    /**
+     * @brief Number of the event, older events in the entry were overwritten
+     * 
+     */
+    uint64_t index;
+
+    /**
+     * @brief Monotonic time, nanoseconds since the kernel booted
+     * 
+     */
+    uint64_t time;
+
+    /**
+     * @brief Numeric arguments, n-th argument is in values[n]
+     * 
+     */
+    int64_t values[RECORDER_VALUES];
+
+    /**
+     * @brief String arguments one after another, each terminated by NUL
+     * 
+     */
+    char text[RECORDER_TEXTLEN];
+};
+
+/**
+ * @brief Argument of recorder_add, text is NULL for numbers
+ * 
+ */
+struct recorder_arg {
+    const char* text;
+    int64_t value;
+};
+
+/*! \cond PRIVATE */
+static inline struct recorder_arg recorder_argText(const char* text) {
+    return (struct recorder_arg){.text = text};
+}
+
+static inline struct recorder_arg recorder_argValue(int64_t value) {
+    return (struct recorder_arg){.value = value};
+}
+
+#define RECORDER_ARG(x) _Generic((x), char*: recorder_argText, const char*: recorder_argText, default: recorder_argValue)(x)
+#define RECORDER_MAP1(a) RECORDER_ARG(a)
+#define RECORDER_MAP2(a, b) RECORDER_ARG(a), RECORDER_ARG(b)
+#define RECORDER_MAP3(a, b, c) RECORDER_ARG(a), RECORDER_ARG(b), RECORDER_ARG(c)
+#define RECORDER_MAP_N(a, b, c, map, ...) map
+#define RECORDER_MAP(...) RECORDER_MAP_N(__VA_ARGS__, RECORDER_MAP3, RECORDER_MAP2, RECORDER_MAP1)(__VA_ARGS__)
+/*! \endcond */
+
+/**
+ * @brief Records the event with up to RECORDER_VALUES arguments, use TRACE instead
+ * Strings are copied, nothing is formatted.
+ */
+#define RECORDER_ADD(name, ...)                                                                              \
+    do {                                                                                                     \
+        const struct recorder_arg recorder_args[] = {RECORDER_MAP(__VA_ARGS__)};                             \
+        recorder_add(RECORDER_EVENT_##name, recorder_args, sizeof(recorder_args) / sizeof(recorder_args[0])); \
+    } while (0)
+
+/**
+ * @brief Reads consistent copy of the entry, never blocks the writer
+ * Can be used by any process which has mapped RECORDER_FILE.
+ * @param entry entry in the mapping
+ * @param out copy
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE if the entry was being written during every try
+ */
+static inline uint8_t recorder_read(const struct recorder_entry* entry, struct recorder_entry* out) {
+    for (uint8_t i = 0; i < RECORDER_RETRIES; i++) {
+        uint32_t seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)  // init is writing it
+            continue;
+        memcpy(out, (const void*)entry, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == seq)
+            return EXIT_SUCCESS;
+    }
+    return EXIT_FAILURE;
+}
+
+/*! \cond PRIVATE */
+static inline void recorder_appendChar(char* buf, size_t* len, size_t size, char c) {
+    if (*len < size)
+        buf[(*len)++] = c;
+}
+
+static inline void recorder_appendNumber(char* buf, size_t* len, size_t size, uint64_t value, uint8_t base) {
+    char digits[20];
+    uint8_t n = 0;
+    do {
+        digits[n++] = "0123456789abcdef"[value % base];
+        value /= base;
+    } while (value != 0);
+    while (n > 0)
+        recorder_appendChar(buf, len, size, digits[--n]);
+}
+/*! \endcond */
+
+/**
+ * @brief Formats the event like TRACE writes it to trace_marker, async-signal-safe
+ * Output isn't terminated by NUL.
+ * @param e copy of the entry
+ * @param buf buffer
+ * @param len current length, updated
+ * @param size size of the buffer
+ */
+static inline void recorder_format(const struct recorder_entry* e, char* buf, size_t* len, size_t size) {
+#define RECORDER_NAME(name) #name " " RECORDER_FMT_##name,
+    static const char* const formats[] = {RECORDER_EVENTS(RECORDER_NAME)};
+#undef RECORDER_NAME
+    const char* fmt = e->event < RECORDER_EVENT_COUNT ? formats[e->event] : "unknown";
+    size_t text = 0;  // next string argument
+    uint8_t arg = 0;
+    for (; *fmt != '\0'; fmt++) {
+        if (*fmt != '%' || fmt[1] == '\0') {
+            recorder_appendChar(buf, len, size, *fmt);
+            continue;
+        }
+        fmt++;
+        if (*fmt == '%') {
+            recorder_appendChar(buf, len, size, '%');
+            continue;
+        }
+        if (arg >= RECORDER_VALUES)
+            break;
+        int64_t value = e->values[arg++];
+        if (*fmt == 's') {
+            for (; text < RECORDER_TEXTLEN && e->text[text] != '\0'; text++)
+                recorder_appendChar(buf, len, size, e->text[text]);
+            text++;
+        } else if (*fmt == 'd' && value < 0) {
+            recorder_appendChar(buf, len, size, '-');
+            recorder_appendNumber(buf, len, size, -(uint64_t)value, 10);
+        } else {
+            recorder_appendNumber(buf, len, size, (uint64_t)value, *fmt == 'x' ? 16 : 10);
+        }
+    }
+}
+
+void recorder_init();
+void recorder_publish();
+void recorder_add(uint16_t event, const struct recorder_arg* args, uint8_t count);
+
+#endif
@@ -0,0 +1,38 @@
+/**
+ * @file runlevel.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef RUNLEVEL_H_INCLUDED
+#define RUNLEVEL_H_INCLUDED
+
+#include <stdint.h>
+
+/**
+ * @brief Highest supported runlevel
+ * 
+ */
+#define RUNLEVEL_MAX 9
+
+/**
+ * @brief Mask of all runlevels, used when runlevels aren't specified
+ * 
+ */
+#define RUNLEVEL_ALL ((uint16_t)((1 << (RUNLEVEL_MAX + 1)) - 1))
+
+/**
+ * @brief Checks if runlevel is in the mask
+ * 
+ */
+#define RUNLEVEL_IN(mask, level) (((mask) >> (level)) & 1)
+
+void runlevel_init();
+uint8_t runlevel_current();
+uint8_t runlevel_parse(const char* str, uint16_t* mask);
+uint8_t runlevel_switch(int level);
+
+#endif
@@ -0,0 +1,40 @@
+/**
+ * @file shutdown.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef SHUTDOWN_H_INCLUDED
+#define SHUTDOWN_H_INCLUDED
+
+/**
+ * @brief Mount table read at shutdown
+ * 
+ */
+#define SHUTDOWN_MOUNTINFO "/proc/self/mountinfo"
+
+/**
+ * @brief Time budget for syncing all filesystems [seconds]
+ * 
+ */
+#define SHUTDOWN_SYNC_TIMEOUT 10
+
+/**
+ * @brief Time budget for unmounting all filesystems [seconds]
+ * 
+ */
+#define SHUTDOWN_UMOUNT_TIMEOUT 10
+
+/**
+ * @brief Maximum number of passes over the mount table, a pass can free mounts for the next one
+ * 
+ */
+#define SHUTDOWN_UMOUNT_PASSES 4
+
+void shutdown_system(int how);
+void shutdown_container();
+
+#endif
@@ -10,9 +10,16 @@
 #ifndef SIGNALS_H_INCLUDED
 #define SIGNALS_H_INCLUDED
 
+#include <signal.h>
 #include <stdint.h>
 
-void signals_setup();
+/**
+ * @brief Signal requesting runlevel change, the runlevel is passed as sigqueue value
+ * 
+ */
+#define SIGNAL_RUNLEVEL SIGRTMIN
+
+void signals_setup(uint8_t container);
 void signals_restoreDefault();
 void signals_blockAll();
 void signals_unblockAll();
@@ -0,0 +1,185 @@
+/**
+ * @file status.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef STATUS_H_INCLUDED
+#define STATUS_H_INCLUDED
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * @brief Identifies the status page, "qist" in little endian
+ * 
+ */
+#define STATUS_MAGIC 0x74736971
+
+/**
+ * @brief Version of the status page layout, changed when entries change
+ * 
+ */
+#define STATUS_VERSION 2
+
+/**
+ * @brief Maximum number of entries in the status page
+ * 
+ */
+#define STATUS_MAXENTRIES 1024
+
+/**
+ * @brief Maximum length of entry name, longer names are truncated
+ * 
+ */
+#define STATUS_NAMELEN 64
+
+/*! \cond PRIVATE */
+#define STATUS_KIND_FREE 0
+#define STATUS_KIND_SERVICE 1
+#define STATUS_KIND_TTY 2
+/*! \endcond */
+
+/**
+ * @brief Header at the beginning of the status page
+ * 
+ */
+struct status_header {
+    uint32_t magic;
+    uint32_t version;
+
+    /**
+     * @brief Number of entries which have been used, readers don't have to look further
+     * 
+     */
+    uint32_t count;
+
+    /**
+     * @brief Size of struct status_entry, so readers can check the layout
+     * 
+     */
+    uint32_t entry_size;
+};
+
+/**
+ * @brief Status of a service or tty
+ * Fields are valid only if seq was even and didn't change while they were copied.
+ */
+struct status_entry {
+    /**
+     * @brief Sequence counter, odd while init is writing the entry
+     * 
+     */
+    uint32_t seq;
+
+    /**
+     * @brief STATUS_KIND_SERVICE, STATUS_KIND_TTY or STATUS_KIND_FREE
+     * 
+     */
+    uint8_t kind;
+
+    /**
+     * @brief SERVICE_* or TTY_STATE_* depending on kind
+     * 
+     */
+    uint8_t state;
+
+    /**
+     * @brief PID of the process, 0 if it isn't running
+     * 
+     */
+    int32_t pid;
+
+    /**
+     * @brief Exit code of the last run, -1 if it was killed
+     * 
+     */
+    int32_t exit_code;
+
+    /**
+     * @brief Signal which killed the last run, otherwise 0
+     * 
+     */
+    int32_t exit_signal;
+
+    /**
+     * @brief Number of restarts since boot
+     * 
+     */
+    uint32_t restarts;
+
+    /**
+     * @brief Timestamp when it was started, 0 if it isn't running
+     * 
+     */
+    int64_t started;
+
+    /**
+     * @brief Number of finished runs of service, resources below are their totals
+     * 
+     */
+    uint32_t runs;
+
+    /**
+     * @brief User and system CPU time [seconds]
+     * 
+     */
+    double cpu_user;
+    double cpu_sys;
+
+    /**
+     * @brief Time between spawns and exits [seconds]
+     * 
+     */
+    double wall;
+
+    /**
+     * @brief Maximum resident set size of any run [kilobytes]
+     * 
+     */
+    int64_t maxrss;
+
+    /**
+     * @brief Major page faults, voluntary and involuntary context switches
+     * 
+     */
+    int64_t majflt;
+    int64_t nvcsw;
+    int64_t nivcsw;
+
+    /**
+     * @brief Name of the service or path of the tty
+     * 
+     */
+    char name[STATUS_NAMELEN];
+};
+
+/**
+ * @brief Reads consistent copy of the entry, never blocks the writer
+ * Can be used by any process which has mapped the status page.
+ * @param entry entry in the mapping
+ * @param out copy
+ */
+static inline void status_read(const struct status_entry* entry, struct status_entry* out) {
+    uint32_t seq;
+    do {
+        while ((seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE)) & 1)
+            ;  // init is writing it
+        memcpy(out, (const void*)entry, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq);
+}
+
+struct process_usage;
+
+void status_init();
+int status_slot(uint8_t kind, const char* name);
+void status_set(int slot, uint8_t state, pid_t pid, time_t started, int exit_code, int exit_signal, uint32_t restarts);
+void status_setUsage(int slot, const struct process_usage* usage);
+void status_release(int slot);
+#endif
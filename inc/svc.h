@@ -15,16 +15,83 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "condition.h"
+#include "loop.h"
+#include "process.h"
+
 /**
  * @brief Maximum length of service name
  * 
  */
 #define SERVICENAME_MAXLEN 128
 
+/**
+ * @brief Maximum number of listening sockets of a socket activated service
+ * 
+ */
+#define SVC_MAX_LISTEN 8
+
+/**
+ * @brief Maximum number of start conditions of a service
+ * 
+ */
+#define SVC_MAX_CONDITIONS 8
+
+/**
+ * @brief Minimum interval between activations of a socket activated service [seconds]
+ * 
+ */
+#define SVC_ACTIVATION_INTERVAL 1
+
+/**
+ * @brief Default timeout of start script, can be changed with start_timeout= [seconds]
+ * 
+ */
+#define SVC_START_TIMEOUT 90
+
+/**
+ * @brief Default timeout of stop script, can be changed with stop_timeout= [seconds]
+ * 
+ */
+#define SVC_STOP_TIMEOUT 90
+
+/**
+ * @brief Default interval of health checks, can be changed with health_interval= [seconds]
+ * 
+ */
+#define SVC_HEALTH_INTERVAL 30
+
+/**
+ * @brief Default number of failed health checks in a row after which the service is restarted
+ * 
+ */
+#define SVC_HEALTH_RETRIES 3
+
+/**
+ * @brief Character which ends name of a template, its instances are named [name@][index]
+ * 
+ */
+#define SVC_TEMPLATE_CHAR '@'
+
+/**
+ * @brief Maximum number of instances of a template
+ * 
+ */
+#define SVC_MAX_INSTANCES 1024
+
 /*! \cond PRIVATE */
 #define SERVICE_STOPPED 0
 #define SERVICE_STARTED 1
 #define SERVICE_STARTING 2
+#define SERVICE_LISTENING 3
+#define SERVICE_CONDITION_FAILED 4
+#define SERVICE_TIMEDOUT 5
+#define SERVICE_SCHEDULED 6
+#define SERVICE_FROZEN 7
+#define SERVICE_STOPPING 8
+
+#define SVC_ON_TIMEOUT_CONTINUE 0
+#define SVC_ON_TIMEOUT_EMERGENCY 1
 /*! \endcond */
 
 /**
@@ -44,12 +111,48 @@ struct service_node {
      */
     time_t time;
 
+    /**
+     * @brief Monotonic timestamp when the last start/stop script was spawned
+     * 
+     */
+    double mono_time;
+
     /**
      * @brief Status of the service
      * 
      */
     uint8_t state;
 
+    /**
+     * @brief Exit code of the last start/stop script, -1 if it was killed
+     * 
+     */
+    int exit_code;
+
+    /**
+     * @brief Signal which killed the last start/stop script, otherwise 0
+     * 
+     */
+    int exit_signal;
+
+    /**
+     * @brief Number of restarts since boot
+     * 
+     */
+    uint32_t restarts;
+
+    /**
+     * @brief Resources used by start/stop scripts and the activated daemon
+     * 
+     */
+    struct process_usage usage;
+
+    /**
+     * @brief Slot in the status page, -1 if it isn't published
+     * 
+     */
+    int status_slot;
+
     /**
      * @brief Startup priority of the service
      * 
@@ -62,6 +165,206 @@ struct service_node {
      */
     uint16_t priority_stop;
 
+    /**
+     * @brief Mask of runlevels in which the service runs
+     * 
+     */
+    uint16_t runlevels;
+
+    /**
+     * @brief Listen specs of socket activated service eg. unix:/run/foo.sock, tcp:8080
+     * 
+     */
+    char* listen[SVC_MAX_LISTEN];
+
+    /**
+     * @brief Sockets held by init for the service, -1 if not opened
+     * 
+     */
+    int listen_fds[SVC_MAX_LISTEN];
+
+    /**
+     * @brief Number of listening sockets, 0 if the service isn't socket activated
+     * 
+     */
+    uint8_t listen_count;
+
+    /**
+     * @brief 1 if listening sockets are watched in the event loop
+     * 
+     */
+    uint8_t listen_watched;
+
+    /**
+     * @brief Timeouts of start and stop scripts, 0 if they can run forever [seconds]
+     * 
+     */
+    double start_timeout;
+    double stop_timeout;
+
+    /**
+     * @brief SVC_ON_TIMEOUT_CONTINUE or SVC_ON_TIMEOUT_EMERGENCY
+     * 
+     */
+    uint8_t on_timeout;
+
+    /**
+     * @brief Timer of running start script, NULL if it isn't armed
+     * 
+     */
+    struct loop_timer* timer;
+
+    /**
+     * @brief Interval of periodic job, 0 if the service isn't one [seconds]
+     * 
+     */
+    double interval;
+
+    /**
+     * @brief Daily or hourly time of periodic job, calendar_minute is -1 if it isn't set
+     * calendar_hour is -1 if the job runs every hour.
+     */
+    int8_t calendar_hour;
+    int8_t calendar_minute;
+
+    /**
+     * @brief Timer of the next run of periodic job, NULL if it isn't scheduled
+     * 
+     */
+    struct loop_timer* job_timer;
+
+    /**
+     * @brief Health check command, NULL if the service isn't checked
+     * 
+     */
+    char* health_cmd;
+
+    /**
+     * @brief Plan for spawning health check, empty if there is no health check
+     * 
+     */
+    struct process_plan health_plan;
+
+    /**
+     * @brief Interval of health checks, a check which runs longer fails [seconds]
+     * 
+     */
+    double health_interval;
+
+    /**
+     * @brief Number of failed health checks in a row after which the service is restarted
+     * 
+     */
+    uint8_t health_retries;
+
+    /**
+     * @brief Number of failed health checks in a row
+     * 
+     */
+    uint8_t health_failures;
+
+    /**
+     * @brief PID of running health check, 0 if none runs
+     * 
+     */
+    pid_t health_pid;
+
+    /**
+     * @brief Timer of the next health check, NULL if it isn't armed
+     * 
+     */
+    struct loop_timer* health_timer;
+
+    /**
+     * @brief PID of stop script running while the unhealthy service restarts, 0 if none runs
+     * 
+     */
+    pid_t stop_pid;
+
+    /**
+     * @brief 1 if init exits with status of this service in container mode
+     * 
+     */
+    uint8_t is_main;
+
+    /**
+     * @brief 1 if ttys are started after this service in early console mode
+     * 
+     */
+    uint8_t before_console;
+
+    /**
+     * @brief Group which is frozen and thawed together, empty if the service is only in its own
+     * 
+     */
+    char group[SERVICENAME_MAXLEN];
+
+    /**
+     * @brief 1 if start script is a shell script which can be sourced in the batch shell
+     * 
+     */
+    uint8_t batchable;
+
+    /**
+     * @brief 1 while start script runs in the batch shell, pid is its subshell
+     * 
+     */
+    uint8_t batched;
+
+    /**
+     * @brief Number of instances of a template, set by instances=, 0 if not set
+     * 
+     */
+    uint16_t instances;
+
+    /**
+     * @brief Index of the instance of a template, -1 if the service isn't an instance
+     * 
+     */
+    int16_t instance;
+
+    /**
+     * @brief TOPOLOGY_CPU or TOPOLOGY_NUMA if instances are pinned to their own CPU or node
+     * 
+     */
+    uint8_t affinity;
+
+    /**
+     * @brief Duration of start script learned in previous boots [seconds], 0 if unknown
+     * 
+     */
+    double learned;
+
+    /**
+     * @brief 1 if the start script waits for a free job slot, state is already starting
+     * 
+     */
+    uint8_t queued;
+
+    /**
+     * @brief Conditions which are checked before the service is started
+     * 
+     */
+    struct condition conditions[SVC_MAX_CONDITIONS];
+
+    /**
+     * @brief Number of conditions
+     * 
+     */
+    uint8_t condition_count;
+
+    /**
+     * @brief Plan for spawning start script, empty if the service isn't started
+     * 
+     */
+    struct process_plan start_plan;
+
+    /**
+     * @brief Plan for spawning stop script, empty if the service isn't stopped
+     * 
+     */
+    struct process_plan stop_plan;
+
     /**
      * @brief Name of the service
      * 
@@ -75,7 +378,13 @@ struct service_node {
     struct service_node* next;
 };
 
-void svc_init();
+uint8_t svc_scan(const char* dirpath);
+void svc_init(uint8_t container);
 void svc_waitForAll();
-void svc_stopEnabledServices();
+void svc_waitForConsole();
+int svc_mainStatus();
+uint8_t svc_getState(const char* name, uint8_t* state, int* exit_code, int* exit_signal);
+int svc_freeze(const char* target, uint8_t freeze);
+void svc_stopEnabledServices(double deadline);
+void svc_switchRunlevel(uint8_t old, uint8_t new);
 #endif
\ No newline at end of file
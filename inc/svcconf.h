@@ -0,0 +1,33 @@
+/**
+ * @file svcconf.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef SVCCONF_H_INCLUDED
+#define SVCCONF_H_INCLUDED
+
+#include <stdint.h>
+
+#include "svc.h"
+
+/**
+ * @brief Suffix of service configuration file stored next to the service in available directory
+ * 
+ */
+#define SVCCONF_SUFFIX ".conf"
+
+/**
+ * @brief Maximum line length in service configuration file
+ * 
+ */
+#define SVCCONF_MAX_LINELEN 512
+
+uint8_t svcconf_load(const char* dir, struct service_node* node);
+uint8_t svcconf_copy(struct service_node* dst, const struct service_node* src);
+void svcconf_free(struct service_node* node);
+
+#endif
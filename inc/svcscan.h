@@ -0,0 +1,27 @@
+/**
+ * @file svcscan.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef SVCSCAN_H_INCLUDED
+#define SVCSCAN_H_INCLUDED
+
+#include <stdint.h>
+
+#include "svc.h"
+
+/**
+ * @brief Initial size of the hash index of services used while scanning
+ * 
+ */
+#define SVCSCAN_INDEX_MINSIZE 64
+
+struct service_node* svcscan_add(struct service_node** head, uint16_t priority_start, uint16_t priority_stop, const char* name);
+const char* svcscan_parseLinkName(const char* filename, uint16_t* priority_start, uint16_t* priority_stop);
+uint8_t svcscan_dir(const char* dirpath, struct service_node** head);
+
+#endif
@@ -0,0 +1,31 @@
+/**
+ * @file timeline.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef TIMELINE_H_INCLUDED
+#define TIMELINE_H_INCLUDED
+
+#include "process.h"
+
+/**
+ * @brief Maximum number of events recorded during boot
+ * 
+ */
+#define TIMELINE_MAXENTRIES 512
+
+/**
+ * @brief Maximum length of event name, longer names are truncated
+ * 
+ */
+#define TIMELINE_NAMELEN 64
+
+void timeline_add(const char* kind, const char* name, double start, double end, const struct process_usage* usage);
+void timeline_write();
+void timeline_handoff();
+void timeline_restore();
+#endif
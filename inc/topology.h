@@ -0,0 +1,42 @@
+/**
+ * @file topology.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef TOPOLOGY_H_INCLUDED
+#define TOPOLOGY_H_INCLUDED
+#include <stdint.h>
+
+/**
+ * @brief Maximum number of CPUs in a set
+ * 
+ */
+#define TOPOLOGY_MAXCPUS 1024
+
+/**
+ * @brief Directory with NUMA nodes
+ * 
+ */
+#define TOPOLOGY_NODE_DIR "/sys/devices/system/node"
+
+#define TOPOLOGY_NONE 0
+#define TOPOLOGY_CPU 1
+#define TOPOLOGY_NUMA 2
+
+/**
+ * @brief Set of CPUs, in the layout which the kernel uses for affinity masks
+ * 
+ */
+struct topology_cpus {
+    unsigned long bits[TOPOLOGY_MAXCPUS / (8 * sizeof(unsigned long))];
+};
+
+uint16_t topology_cpuCount();
+uint8_t topology_cpuSet(uint8_t kind, uint16_t index, struct topology_cpus *out);
+void topology_apply(const struct topology_cpus *cpus);
+
+#endif
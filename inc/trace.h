@@ -0,0 +1,90 @@
+/**
+ * @file trace.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRACE_HAVE_USDT 1
+#endif
+#endif
+
+#include "recorder.h"
+
+/**
+ * @brief Mountpoint of tracefs
+ * 
+ */
+#define TRACE_TRACEFS "/sys/kernel/tracing"
+
+/**
+ * @brief File to which trace events are written, they appear in the kernel trace
+ * 
+ */
+#define TRACE_MARKER_FILE TRACE_TRACEFS "/trace_marker"
+
+/**
+ * @brief Maximum length of one trace event
+ * 
+ */
+#define TRACE_MAXLEN 256
+
+/**
+ * @brief Descriptor of TRACE_MARKER_FILE, -1 if writing events is disabled
+ * 
+ */
+extern int trace_fd;
+
+/*! \cond PRIVATE */
+#ifdef TRACE_HAVE_USDT
+#define TRACE_PROBE(name, ...) STAP_PROBEV(quickinit, name, ##__VA_ARGS__)
+#else
+#define TRACE_PROBE(name, ...) \
+    do {                       \
+    } while (0)
+#endif
+/*! \endcond */
+
+/*! \cond PRIVATE */
+#define TRACE_MARKER_WRITE(name, ...)                                             \
+    do {                                                                          \
+        if (__builtin_expect(trace_fd >= 0, 0))                                   \
+            trace_write("quickinit: " #name " " RECORDER_FMT_##name "\n", __VA_ARGS__); \
+    } while (0)
+/*! \endcond */
+
+/**
+ * @brief Emits tracepoint: USDT probe quickinit:name with the arguments, event in the flight recorder and,
+ * when enabled, a line in trace_marker formatted by RECORDER_FMT_name
+ * USDT probe is a nop until a tracer attaches and disabled trace_marker costs one predicted branch. The recorder
+ * is always on, it reads the clock and copies the arguments, they're formatted only when the events are read.
+ */
+#define TRACE(name, ...)                      \
+    do {                                      \
+        TRACE_PROBE(name, __VA_ARGS__);       \
+        RECORDER_ADD(name, __VA_ARGS__);      \
+        TRACE_MARKER_WRITE(name, __VA_ARGS__); \
+    } while (0)
+
+/**
+ * @brief TRACE for the child between fork and exec, which doesn't touch the flight recorder of init
+ * 
+ */
+#define TRACE_CHILD(name, ...)                \
+    do {                                      \
+        TRACE_PROBE(name, __VA_ARGS__);       \
+        TRACE_MARKER_WRITE(name, __VA_ARGS__); \
+    } while (0)
+
+void trace_init();
+void trace_write(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#endif
@@ -9,32 +9,37 @@
  */
 #ifndef TTY_H_INCLUDED
 #define TTY_H_INCLUDED
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 #include <time.h>
 
+#include "arena.h"
+#include "process.h"
+
 /**
- * @brief Maximum number of ttys in the system
+ * @brief Path to the tty configuration file
  * 
  */
-#define TTY_MAXTTYS 128
+#define TTY_CONFIG "/etc/quickinit/tty"
 
 /**
- * @brief Maximum line length in tty config file
+ * @brief Initial capacity of the tty table
  * 
  */
-#define TTY_MAX_LINELEN 256
+#define TTY_TABLE_MINSIZE 8
 
 /**
- * @brief Maximum device name length in tty config file
+ * @brief Replaced with device name in command of pattern entries eg. ttyUSB*::respawn:/sbin/getty 115200 $TTY
  * 
  */
-#define TTY_MAX_DEVNAMELEN 64
+#define TTY_PATTERN_VAR "$TTY"
 
 /**
- * @brief Maximum command length in tty config file
+ * @brief Size of buffer for kobject uevent messages
  * 
  */
-#define TTY_MAX_CMDLEN 128  // tty max command length
+#define TTY_UEVENT_BUFSIZE 4096
 
 /**
  * @brief Minimum interval between tty restarts [seconds]
@@ -42,19 +47,27 @@
  */
 #define TTY_STARTINTERVAL 1
 
+/**
+ * @brief Prompt printed on askfirst ttys
+ * 
+ */
+#define TTY_ASKFIRST_PROMPT "Please press Enter to activate this console. \r\n"
+
 /*! \cond PRIVATE */
 #define TTY_STATE_STOPPED 0
 #define TTY_STATE_RUNNING 1
+#define TTY_STATE_WAITING 2
 #define TTY_ACTION_ASKFIRST 0
 #define TTY_ACTION_ONCE 1
 #define TTY_ACTION_RESPAWN 2
 /*! \endcond */
 
-uint8_t tty_start(uint8_t tty);
-uint8_t tty_stop(uint8_t tty);
-uint8_t tty_check(uint8_t pid);
-uint8_t tty_respawn(uint8_t pid);
+uint8_t tty_start(size_t tty);
+uint8_t tty_stop(size_t tty);
+uint8_t tty_respawn(size_t tty);
+uint8_t tty_load(const char *path);
 void tty_init();
+void tty_switchRunlevel(uint8_t old, uint8_t new);
 
 /**
  * @brief Structure storing informations about specific TTY
@@ -92,18 +105,70 @@ struct tty_struct {
     uint8_t is_tty;
 
     /**
-     * @brief tty name or empty, without beginning /dev/ eg. ttyS1
+     * @brief 1 if the entry was created for a hotplugged device matching a pattern entry
+     * 
+     */
+    uint8_t hotplug;
+
+    /**
+     * @brief Mask of runlevels in which the TTY runs
+     * 
+     */
+    uint16_t runlevels;
+
+    /**
+     * @brief Descriptor of askfirst tty opened by init while waiting for Enter, otherwise -1
+     * 
+     */
+    int ask_fd;
+
+    /**
+     * @brief Number of respawns since boot
+     * 
+     */
+    uint32_t restarts;
+
+    /**
+     * @brief Exit code of the last run, -1 if it was killed
      * 
      */
-    char dev[TTY_MAX_DEVNAMELEN];
+    int exit_code;
+
+    /**
+     * @brief Signal which killed the last run, otherwise 0
+     * 
+     */
+    int exit_signal;
+
+    /**
+     * @brief Slot in the status page, -1 if it isn't published
+     * 
+     */
+    int status_slot;
+
+    /**
+     * @brief Path to the tty eg. /dev/ttyS1 (glob for pattern entries) or name from config file if it is not a tty
+     * 
+     */
+    char *dev;
 
     /**
      * @brief Command which has to be run after starting
      * 
      */
-    char command[TTY_MAX_CMDLEN];
-};
+    char *command;
+
+    /**
+     * @brief Plan for spawning the command, empty for pattern entries
+     * 
+     */
+    struct process_plan plan;
 
-extern struct tty_struct tty_data[TTY_MAXTTYS];
+    /**
+     * @brief Arena holding the hotplugged entry itself, its strings and plan, freed when the device is removed
+     * 
+     */
+    struct arena arena;
+};
 
 #endif
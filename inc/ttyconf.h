@@ -0,0 +1,64 @@
+/**
+ * @file ttyconf.h
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#ifndef TTYCONF_H_INCLUDED
+#define TTYCONF_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "tty.h"
+
+/**
+ * @brief Growable array of ttys, entries are allocated separately so pointers to them stay valid
+ * 
+ */
+struct tty_table {
+    struct tty_struct **items;
+    size_t count;
+    size_t capacity;
+};
+
+/**
+ * @brief Entries of the tty configuration file
+ * 
+ */
+struct tty_config {
+    /**
+     * @brief Entries from config file and hotplugged devices
+     * 
+     */
+    struct tty_table ttys;
+
+    /**
+     * @brief Pattern entries eg. ttyUSB*
+     * 
+     */
+    struct tty_table patterns;
+
+    /**
+     * @brief Arena with entries from config file, /dev/ prefixed device paths and plans
+     * 
+     */
+    struct arena arena;
+
+    /**
+     * @brief Private mapping of the config file, the other strings of entries point into it
+     * 
+     */
+    char *map;
+    size_t map_size;
+};
+
+uint8_t ttyconf_append(struct tty_table *table, struct tty_struct *t);
+uint8_t ttyconf_load(const char *path, struct tty_config *conf);
+void ttyconf_free(struct tty_config *conf);
+
+#endif
@@ -10,6 +10,7 @@
 #ifndef UTILITIES_H_INCLUDED
 #define UTILITIES_H_INCLUDED
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/stat.h>
 
@@ -17,4 +18,7 @@ uint8_t util_isMounted(char *dirpath);
 uint8_t util_isInFstab(char *dirpath);
 uint8_t util_dirExists(const char *dirpath);
 void util_dirCreate(const char *dirpath, mode_t mode);
+double util_monotonicTime();
+uint32_t util_hashName(const char *name);
+uint8_t util_cmdlineGet(const char *key, char *buf, size_t size);
 #endif
@@ -0,0 +1,148 @@
+/**
+ * @file activation.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "activation.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "console.h"
+
+/**
+ * @brief Parses inet part of listen spec: [address:]port
+ * 
+ * @param str address and port
+ * @param addr output address
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseInet(const char* str, struct sockaddr_in* addr) {
+    char host[INET_ADDRSTRLEN];
+    const char* port = strrchr(str, ':');
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (port) {
+        size_t hostlen = port - str;
+        if (hostlen == 0 || hostlen >= sizeof(host))
+            return EXIT_FAILURE;
+        memcpy(host, str, hostlen);
+        host[hostlen] = '\0';
+        if (inet_pton(AF_INET, host, &addr->sin_addr) != 1)
+            return EXIT_FAILURE;
+        port++;
+    } else {
+        port = str;
+    }
+
+    char* end;
+    long num = strtol(port, &end, 10);
+    if (*port == '\0' || *end != '\0' || num <= 0 || num > 65535)
+        return EXIT_FAILURE;
+    addr->sin_port = htons((uint16_t)num);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Checks syntax of listen spec
+ * unix:/path, tcp:[address:]port or udp:[address:]port
+ * @param spec listen spec
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t activation_validate(const char* spec) {
+    struct sockaddr_in addr;
+
+    if (strncmp(spec, "unix:", 5) == 0)
+        return (spec[5] == '/' && strlen(spec + 5) < sizeof(((struct sockaddr_un*)0)->sun_path)) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (strncmp(spec, "tcp:", 4) == 0 || strncmp(spec, "udp:", 4) == 0)
+        return parseInet(spec + 4, &addr);
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief Creates listening unix socket
+ * 
+ * @param path path of the socket
+ * @return int file descriptor or -1
+ */
+static int openUnix(const char* path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    unlink(addr.sun_path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+    }
+    chmod(addr.sun_path, ACTIVATION_UNIX_MODE);
+    return fd;
+}
+
+/**
+ * @brief Creates listening TCP or bound UDP socket
+ * 
+ * @param str [address:]port
+ * @param type SOCK_STREAM or SOCK_DGRAM
+ * @return int file descriptor or -1
+ */
+static int openInet(const char* str, int type) {
+    struct sockaddr_in addr;
+    if (parseInet(str, &addr) != EXIT_SUCCESS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd = socket(AF_INET, type | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || (type == SOCK_STREAM && listen(fd, SOMAXCONN) < 0)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Creates listening socket described by the spec
+ * 
+ * @param spec unix:/path, tcp:[address:]port or udp:[address:]port
+ * @return int file descriptor or -1
+ */
+int activation_open(const char* spec) {
+    int fd = -1;
+
+    if (strncmp(spec, "unix:", 5) == 0)
+        fd = openUnix(spec + 5);
+    else if (strncmp(spec, "tcp:", 4) == 0)
+        fd = openInet(spec + 4, SOCK_STREAM);
+    else if (strncmp(spec, "udp:", 4) == 0)
+        fd = openInet(spec + 4, SOCK_DGRAM);
+    else
+        errno = EINVAL;
+
+    if (fd < 0)
+        console_error("failed listening on %s: %s\r\n", spec, strerror(errno));
+    return fd;
+}
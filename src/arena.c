@@ -0,0 +1,78 @@
+/**
+ * @file arena.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Initializes empty arena
+ * 
+ * @param a arena
+ */
+void arena_init(struct arena* a) {
+    a->head = NULL;
+}
+
+/**
+ * @brief Allocates memory from the arena, it is valid until arena_free
+ * 
+ * @param a arena
+ * @param size size in bytes
+ * @return void* aligned memory or NULL
+ */
+void* arena_alloc(struct arena* a, size_t size) {
+    const size_t align = alignof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+
+    struct arena_block* b = a->head;
+    if (!b || b->size - b->used < size) {
+        size_t block_size = size > ARENA_BLOCKSIZE ? size : ARENA_BLOCKSIZE;
+        b = (struct arena_block*)malloc(sizeof(struct arena_block) + block_size);
+        if (!b)
+            return NULL;
+        b->size = block_size;
+        b->used = 0;
+        b->next = a->head;
+        a->head = b;
+    }
+
+    void* ptr = b->data + b->used;
+    b->used += size;
+    return ptr;
+}
+
+/**
+ * @brief Copies string to the arena
+ * 
+ * @param a arena
+ * @param str string
+ * @return char* copy or NULL
+ */
+char* arena_strdup(struct arena* a, const char* str) {
+    size_t len = strlen(str) + 1;
+    char* copy = (char*)arena_alloc(a, len);
+    if (copy)
+        memcpy(copy, str, len);
+    return copy;
+}
+
+/**
+ * @brief Frees everything allocated from the arena, it can be used again
+ * 
+ * @param a arena
+ */
+void arena_free(struct arena* a) {
+    while (a->head) {
+        struct arena_block* next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+}
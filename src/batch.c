@@ -0,0 +1,304 @@
+/**
+ * @file batch.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#define _GNU_SOURCE
+#include "batch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+
+#include "arena.h"
+#include "console.h"
+#include "loop.h"
+
+/**
+ * @brief Script running in the batch shell
+ * 
+ */
+struct batch_job {
+    uint32_t id;
+    pid_t pid;          // subshell running the script, 0 until it's reported
+    uint8_t cancelled;  // 1 if the owner isn't notified anymore, the subshell is killed once it's reported
+    batch_startedCallback started;
+    process_exitCallback exited;
+    void *owner;
+};
+
+/**
+ * @brief Batch shell, it's spawned on demand and exits when it has nothing to run
+ * Every script is sourced in a background subshell, so the shell is started once
+ * for many scripts. The subshell reports its PID and exit status on stdout of the shell:
+ * P [id] [pid]
+ * E [id] [status]
+ */
+static struct {
+    int cmd_fd;     // stdin of the shell, -1 when it's closed
+    int report_fd;  // stdout of the shell and its subshells, -1 when all of them have exited
+    char report[BATCH_REPORTLEN];
+    size_t report_len;
+} shell = {-1, -1, {0}, 0};
+
+static struct process_plan plan = {NULL};
+static struct arena batch_arena = {NULL};
+static struct batch_job jobs[BATCH_MAXJOBS];
+static size_t job_count = 0;
+static uint32_t next_id = 1;
+
+/**
+ * @brief Searches running script
+ * 
+ * @param id id of the script
+ * @return struct batch_job* script or NULL
+ */
+static struct batch_job *findJob(uint32_t id) {
+    for (size_t i = 0; i < job_count; i++) {
+        if (jobs[i].id == id)
+            return &jobs[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Notifies owner of the script that it has exited
+ * 
+ * @param job script, already removed from running ones, the callback may submit more scripts
+ * @param status exit status as the shell reports it
+ */
+static void notifyExited(const struct batch_job *job, int status) {
+    if (job->cancelled)
+        return;
+    struct process_exit ex = {.pid = job->pid, .code = status, .signal = 0};  // usage isn't known
+    if (status > 128) {  // killed by a signal
+        ex.code = -1;
+        ex.signal = status - 128;
+    }
+    job->exited(job->owner, &ex);
+}
+
+/**
+ * @brief Closes stdin of the shell when nothing runs, so it exits
+ * 
+ */
+static void closeIdle() {
+    if (job_count == 0 && shell.cmd_fd >= 0) {
+        close(shell.cmd_fd);
+        shell.cmd_fd = -1;
+    }
+}
+
+/**
+ * @brief Handles one line reported by a subshell
+ * 
+ * @param line line without newline
+ */
+static void handleReport(const char *line) {
+    char kind;
+    unsigned int id;
+    int value;
+    if (sscanf(line, "%c %u %d", &kind, &id, &value) != 3)
+        return;
+
+    struct batch_job *job = findJob(id);
+    if (!job)
+        return;
+    if (kind == 'P') {
+        job->pid = value;
+        if (job->cancelled)
+            kill(value, SIGKILL);
+        else
+            job->started(job->owner, value);
+    } else if (kind == 'E') {
+        struct batch_job done = *job;
+        *job = jobs[--job_count];
+        notifyExited(&done, value);
+        closeIdle();
+    }
+}
+
+/**
+ * @brief Reads reports of subshells, fails remaining scripts when all of them have exited
+ * 
+ * @param fd stdout of the shell
+ * @param events unused
+ * @param data unused
+ */
+static void reportReadable(int fd, uint32_t events, void *data) {
+    ssize_t len = read(fd, shell.report + shell.report_len, sizeof(shell.report) - 1 - shell.report_len);
+    if (len < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+
+    if (len > 0) {
+        shell.report_len += len;
+        shell.report[shell.report_len] = '\0';
+        char *line = shell.report;
+        char *eol;
+        while ((eol = strchr(line, '\n')) != NULL) {
+            *eol = '\0';
+            handleReport(line);
+            line = eol + 1;
+        }
+        shell.report_len = strlen(line);
+        if (shell.report_len == sizeof(shell.report) - 1)  // garbage without newline
+            shell.report_len = 0;
+        memmove(shell.report, line, shell.report_len);
+        return;
+    }
+
+    loop_removeFd(fd);  // everything has exited, scripts which didn't report never ran
+    close(fd);
+    shell.report_fd = -1;
+    shell.report_len = 0;
+    if (shell.cmd_fd >= 0) {
+        close(shell.cmd_fd);
+        shell.cmd_fd = -1;
+    }
+    if (job_count == 0)
+        return;
+    console_error("batch shell exited with %zu scripts not finished\r\n", job_count);
+    struct batch_job failed[BATCH_MAXJOBS];
+    size_t count = job_count;
+    memcpy(failed, jobs, count * sizeof(struct batch_job));
+    job_count = 0;  // callbacks may submit scripts to a new shell
+    for (size_t i = 0; i < count; i++)
+        notifyExited(&failed[i], PROCESS_EXEC_FAILED);
+}
+
+/**
+ * @brief Spawns the batch shell
+ * 
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t spawnShell() {
+    if (!plan.path && process_buildPlan(&batch_arena, &plan, BATCH_SHELL, NULL) != EXIT_SUCCESS) {
+        plan.path = NULL;
+        return EXIT_FAILURE;
+    }
+
+    int cmd[2], report[2];
+    if (pipe2(cmd, O_CLOEXEC) < 0)
+        return EXIT_FAILURE;
+    if (pipe2(report, O_CLOEXEC | O_NONBLOCK) < 0) {
+        close(cmd[0]);
+        close(cmd[1]);
+        return EXIT_FAILURE;
+    }
+
+    pid_t pid = process_spawnPiped(&plan, cmd[0], report[1]);  // reaped as an orphan, its subshells report
+    close(cmd[0]);
+    close(report[1]);
+    if (pid < 0 || loop_addFd(report[0], EPOLLIN, reportReadable, NULL) != EXIT_SUCCESS) {
+        close(cmd[1]);
+        close(report[0]);
+        return EXIT_FAILURE;
+    }
+    shell.cmd_fd = cmd[1];
+    shell.report_fd = report[0];
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Quotes string for the shell
+ * 
+ * @param str string
+ * @param buf output buffer
+ * @param size size of the buffer
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE if it doesn't fit
+ */
+static uint8_t quote(const char *str, char *buf, size_t size) {
+    size_t n = 0;
+    if (size < 3)
+        return EXIT_FAILURE;
+    buf[n++] = '\'';
+    for (; *str != '\0'; str++) {
+        if (*str == '\'') {
+            if (n + 4 >= size)
+                return EXIT_FAILURE;
+            memcpy(buf + n, "'\\''", 4);
+            n += 4;
+        } else {
+            if (n + 1 >= size)
+                return EXIT_FAILURE;
+            buf[n++] = *str;
+        }
+    }
+    if (n + 2 > size)
+        return EXIT_FAILURE;
+    buf[n++] = '\'';
+    buf[n] = '\0';
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Runs shell script in the batch shell, without its own shell process
+ * The script is sourced in a subshell, so $0 is the batch shell. Its stdin is /dev/null
+ * and output goes where stderr of the batch shell goes.
+ * @param script path of the script
+ * @param arg argument of the script eg. start
+ * @param procs cgroup.procs which the subshell joins before the script runs, NULL to stay in the cgroup of the batch shell
+ * @param started called when PID of the subshell is known
+ * @param exited called when the script exits
+ * @param owner pointer passed to the callbacks
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE if the script must be spawned the usual way
+ */
+uint8_t batch_submit(const char *script, const char *arg, const char *procs, batch_startedCallback started, process_exitCallback exited, void *owner) {
+    if (job_count == BATCH_MAXJOBS)
+        return EXIT_FAILURE;
+    if (shell.cmd_fd < 0) {
+        if (shell.report_fd >= 0)  // previous shell is still exiting
+            return EXIT_FAILURE;
+        if (spawnShell() != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+
+    char quoted_script[PATH_MAX * 2];
+    char quoted_arg[64];
+    char join[PATH_MAX * 2 + 16] = "";  // daemons started by the script stay in the cgroup
+    char cmd[sizeof(quoted_script) + sizeof(quoted_arg) + sizeof(join) + 128];
+    if (quote(script, quoted_script, sizeof(quoted_script)) != EXIT_SUCCESS || quote(arg, quoted_arg, sizeof(quoted_arg)) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    if (procs) {
+        char quoted_procs[PATH_MAX * 2];
+        if (quote(procs, quoted_procs, sizeof(quoted_procs)) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        snprintf(join, sizeof(join), "echo 0 >%s; ", quoted_procs);
+    }
+    uint32_t id = next_id++;
+    int len = snprintf(cmd, sizeof(cmd), "{ (%sset -- %s; . %s) </dev/null >&2 & echo \"P %u $!\"; wait $!; echo \"E %u $?\"; } </dev/null &\n", join, quoted_arg, quoted_script, id, id);
+    if (len < 0 || (size_t)len >= sizeof(cmd))
+        return EXIT_FAILURE;
+
+    if (write(shell.cmd_fd, cmd, len) != len) {  // shell has died, it's restarted when its subshells exit
+        close(shell.cmd_fd);
+        shell.cmd_fd = -1;
+        return EXIT_FAILURE;
+    }
+    jobs[job_count++] = (struct batch_job){id, 0, 0, started, exited, owner};
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Kills scripts of the owner, its callbacks aren't called anymore
+ * 
+ * @param owner pointer passed to batch_submit
+ */
+void batch_cancel(void *owner) {
+    for (size_t i = 0; i < job_count; i++) {
+        if (jobs[i].owner != owner || jobs[i].cancelled)
+            continue;
+        jobs[i].cancelled = 1;
+        if (jobs[i].pid > 0)
+            kill(jobs[i].pid, SIGKILL);
+    }
+}
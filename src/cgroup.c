@@ -0,0 +1,174 @@
+/**
+ * @file cgroup.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "cgroup.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/magic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+
+#include "console.h"
+#include "utilities.h"
+
+static char base[PATH_MAX];  // directory of CGROUP_NAME, empty if cgroups aren't available
+
+/**
+ * @brief Writes value to a file of the cgroup
+ * 
+ * @param path path of the file
+ * @param value value
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t writeFile(const char *path, const char *value) {
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return EXIT_FAILURE;
+    ssize_t len = write(fd, value, strlen(value));
+    close(fd);
+    return len == (ssize_t)strlen(value) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Reads cgroup of init from /proc/self/cgroup, "/" unless init runs in a container
+ * 
+ * @param out output
+ * @param size size of the output
+ */
+static void ownCgroup(char *out, size_t size) {
+    char line[PATH_MAX];
+    snprintf(out, size, "/");
+    FILE *fp = fopen("/proc/self/cgroup", "r");
+    if (!fp)
+        return;
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "0::", 3) == 0) {  // entry of the v2 hierarchy
+            line[strcspn(line, "\n")] = '\0';
+            if (snprintf(out, size, "%s", line + 3) >= (int)size)
+                snprintf(out, size, "/");
+            break;
+        }
+    }
+    fclose(fp);
+}
+
+/**
+ * @brief Checks if the directory is cgroup v2 hierarchy
+ * 
+ * @param path directory
+ * @return uint8_t 1 if it is
+ */
+static uint8_t isCgroup2(const char *path) {
+    struct statfs st;
+    return statfs(path, &st) == 0 && st.f_type == CGROUP2_SUPER_MAGIC;
+}
+
+/**
+ * @brief Finds or mounts cgroup v2 hierarchy and creates CGROUP_NAME in the cgroup of init
+ * Hybrid setups have it in CGROUP_UNIFIED, it's mounted only if nothing is on CGROUP_ROOT.
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE if services can't have own cgroups
+ */
+uint8_t cgroup_init() {
+    const char *root = CGROUP_ROOT;
+    if (!isCgroup2(root)) {
+        root = CGROUP_UNIFIED;
+        if (!isCgroup2(root)) {
+            root = CGROUP_ROOT;
+            util_dirCreate(root, 0755);
+            if (util_isMounted(CGROUP_ROOT) || mount("cgroup2", root, "cgroup2", MS_NODEV | MS_NOSUID | MS_NOEXEC, NULL) < 0) {
+                console_debug("cgroup v2 isn't available, services can't be frozen\r\n");
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    char own[PATH_MAX];
+    ownCgroup(own, sizeof(own));
+    if (snprintf(base, sizeof(base), "%s%s%s" CGROUP_NAME, root, own, own[strlen(own) - 1] == '/' ? "" : "/") >= (int)sizeof(base) ||
+        (mkdir(base, 0755) < 0 && errno != EEXIST)) {
+        console_debug("failed creating %s: %s, services can't be frozen\r\n", base, strerror(errno));
+        base[0] = '\0';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Creates cgroup of the service
+ * 
+ * @param name name of the service
+ * @return const char* path of its cgroup.procs, static buffer, or NULL if it can't be created
+ */
+const char *cgroup_create(const char *name) {
+    static char procs[PATH_MAX];
+    if (base[0] == '\0')
+        return NULL;
+    char dir[PATH_MAX];
+    if (snprintf(dir, sizeof(dir), "%s/%s", base, name) >= (int)sizeof(dir) || (mkdir(dir, 0755) < 0 && errno != EEXIST) ||
+        snprintf(procs, sizeof(procs), "%s/cgroup.procs", dir) >= (int)sizeof(procs)) {
+        console_error("failed creating cgroup of %s: %s\r\n", name, strerror(errno));
+        return NULL;
+    }
+    cgroup_freeze(name, 0);  // left frozen by previous init, eg. in a restarted container
+    return procs;
+}
+
+/**
+ * @brief Moves the calling process to the cgroup, runs in the child before exec
+ * 
+ * @param procs path of cgroup.procs
+ */
+void cgroup_join(const char *procs) {
+    if (writeFile(procs, "0") != EXIT_SUCCESS)  // 0 is the writing process
+        console_error("failed joining %s: %s\r\n", procs, strerror(errno));
+}
+
+/**
+ * @brief Freezes or thaws all processes in the cgroup of the service
+ * Frozen processes keep their memory and caches, thawing is instant.
+ * @param name name of the service
+ * @param freeze 1 freezes, 0 thaws
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t cgroup_freeze(const char *name, uint8_t freeze) {
+    char path[PATH_MAX];
+    if (base[0] == '\0')
+        return EXIT_FAILURE;
+    if (snprintf(path, sizeof(path), "%s/%s/cgroup.freeze", base, name) >= (int)sizeof(path))
+        return EXIT_FAILURE;
+    return writeFile(path, freeze ? "1" : "0");
+}
+
+/**
+ * @brief Checks if the cgroup of the service has any processes, from populated in its cgroup.events
+ * 
+ * @param name name of the service
+ * @return uint8_t 1 if it has
+ */
+uint8_t cgroup_populated(const char *name) {
+    char path[PATH_MAX], line[64];
+    uint8_t populated = 0;
+    if (base[0] == '\0' || snprintf(path, sizeof(path), "%s/%s/cgroup.events", base, name) >= (int)sizeof(path))
+        return 0;
+    FILE *fp = fopen(path, "re");
+    if (!fp)
+        return 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (strcmp(line, "populated 1\n") == 0)
+            populated = 1;
+    }
+    fclose(fp);
+    return populated;
+}
@@ -0,0 +1,345 @@
+/**
+ * @file condition.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#define _GNU_SOURCE
+#include "condition.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utilities.h"
+
+/*! \cond PRIVATE */
+#define VIRT_NONE 0
+#define VIRT_VM 1
+#define VIRT_CONTAINER 2
+/*! \endcond */
+
+/**
+ * @brief Virtualization detected by detectVirtualization
+ * 
+ */
+static struct {
+    uint8_t detected;  // 1 if it was already detected, it doesn't change while running
+    uint8_t kind;      // VIRT_*
+    const char* id;    // eg. kvm, docker, NULL if not virtualized
+} virt = {0, VIRT_NONE, NULL};
+
+/**
+ * @brief DMI vendors and products of hypervisors
+ * 
+ */
+static const struct {
+    const char* prefix;
+    const char* id;
+} dmi_vendors[] = {
+    {"KVM", "kvm"},
+    {"QEMU", "qemu"},
+    {"VMware", "vmware"},
+    {"VMW", "vmware"},
+    {"innotek GmbH", "oracle"},
+    {"VirtualBox", "oracle"},
+    {"Oracle Corporation", "oracle"},
+    {"Xen", "xen"},
+    {"Bochs", "bochs"},
+    {"Parallels", "parallels"},
+    {"BHYVE", "bhyve"},
+    {"Google Compute Engine", "google"},
+};
+
+/**
+ * @brief Vendors which also sell physical machines, their VMs are told apart by DMI product name
+ * 
+ */
+static const struct {
+    const char* vendor;
+    const char* product;  // prefix of product name of VMs, NULL if all but bare metal *.metal instances are VMs
+    const char* id;
+} dmi_products[] = {
+    {"Microsoft Corporation", "Virtual Machine", "microsoft"},  // Hyper-V and Azure, Surface has the same vendor
+    {"Amazon EC2", NULL, "amazon"},                             // product name is the instance type eg. m5.large
+};
+
+/**
+ * @brief Names of conditions as written in service configuration file
+ * 
+ */
+static const char* names[] = {
+    "condition_path_exists",
+    "condition_mountpoint",
+    "condition_kernel_cmdline",
+    "condition_file_not_empty",
+    "condition_virtualization",
+};
+
+/**
+ * @brief Reads first line of a small file
+ * 
+ * @param path path of the file
+ * @param buf output buffer
+ * @param size size of the buffer
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t readLine(const char* path, char* buf, size_t size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return EXIT_FAILURE;
+    ssize_t len = read(fd, buf, size - 1);
+    close(fd);
+    if (len < 0)
+        return EXIT_FAILURE;
+    buf[len] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Checks if DMI vendor and product name are of a VM of vendor which also sells physical machines
+ * 
+ * @param vendor sys_vendor
+ * @param product product_name
+ * @return const char* id of the VM or NULL
+ */
+static const char* dmiProductVm(const char* vendor, const char* product) {
+    for (size_t i = 0; i < sizeof(dmi_products) / sizeof(dmi_products[0]); i++) {
+        if (strcmp(vendor, dmi_products[i].vendor) != 0)
+            continue;
+        if (dmi_products[i].product)
+            return strncmp(product, dmi_products[i].product, strlen(dmi_products[i].product)) == 0 ? dmi_products[i].id : NULL;
+        size_t len = strlen(product);
+        uint8_t metal = len >= strlen(".metal") && strcmp(product + len - strlen(".metal"), ".metal") == 0;
+        return metal ? NULL : dmi_products[i].id;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Checks if /proc/cpuinfo has the hypervisor flag
+ * 
+ * @return uint8_t 1 if it has
+ */
+static uint8_t cpuHasHypervisorFlag() {
+    FILE* fp = fopen("/proc/cpuinfo", "re");
+    if (!fp)
+        return 0;
+
+    char line[4096];
+    uint8_t found = 0;
+    while (!found && fgets(line, sizeof(line), fp) != NULL) {
+        if (strncmp(line, "flags", 5) == 0 && strstr(line, " hypervisor") != NULL)
+            found = 1;
+    }
+    fclose(fp);
+    return found;
+}
+
+/**
+ * @brief Detects container from environment and files left by container managers
+ * It doesn't need /proc or /sys, so it works before they are mounted.
+ * @return const char* id of the container eg. docker or NULL
+ */
+static const char* detectContainer() {
+    const char* container = getenv("container");  // set by container managers for PID 1
+    if (container && *container != '\0')
+        return container;
+    if (access("/run/.containerenv", F_OK) == 0)
+        return "podman";
+    if (access("/.dockerenv", F_OK) == 0)
+        return "docker";
+    return NULL;
+}
+
+/**
+ * @brief Detects container or virtual machine, only once
+ * VMs are detected from /sys and /proc, so it must not be called before they are mounted.
+ */
+static void detectVirtualization() {
+    if (virt.detected)
+        return;
+    virt.detected = 1;
+
+    const char* container = detectContainer();
+    if (container) {
+        virt.kind = VIRT_CONTAINER;
+        virt.id = container;
+        return;
+    }
+
+    char buf[256];
+    char product[256];
+    if (readLine("/sys/class/dmi/id/sys_vendor", buf, sizeof(buf)) == EXIT_SUCCESS &&
+        readLine("/sys/class/dmi/id/product_name", product, sizeof(product)) == EXIT_SUCCESS) {
+        const char* id = dmiProductVm(buf, product);
+        if (id) {
+            virt.kind = VIRT_VM;
+            virt.id = id;
+            return;
+        }
+    }
+    const char* dmi[] = {"/sys/class/dmi/id/sys_vendor", "/sys/class/dmi/id/product_name", "/sys/class/dmi/id/bios_vendor"};
+    for (size_t i = 0; i < sizeof(dmi) / sizeof(dmi[0]); i++) {
+        if (readLine(dmi[i], buf, sizeof(buf)) != EXIT_SUCCESS)
+            continue;
+        for (size_t j = 0; j < sizeof(dmi_vendors) / sizeof(dmi_vendors[0]); j++) {
+            if (strncmp(buf, dmi_vendors[j].prefix, strlen(dmi_vendors[j].prefix)) == 0) {
+                virt.kind = VIRT_VM;
+                virt.id = dmi_vendors[j].id;
+                return;
+            }
+        }
+    }
+    if (access("/proc/xen", F_OK) == 0) {
+        virt.kind = VIRT_VM;
+        virt.id = "xen";
+        return;
+    }
+    if (cpuHasHypervisorFlag()) {
+        virt.kind = VIRT_VM;
+        virt.id = "vm-other";
+    }
+}
+
+/**
+ * @brief Checks if the path is root of a mount
+ * 
+ * @param path path
+ * @return uint8_t 1 if it is
+ */
+static uint8_t isMountpoint(const char* path) {
+#ifdef STATX_ATTR_MOUNT_ROOT
+    struct statx stx;
+    if (statx(AT_FDCWD, path, 0, STATX_BASIC_STATS, &stx) < 0)
+        return 0;
+    if (stx.stx_attributes_mask & STATX_ATTR_MOUNT_ROOT)  // also detects bind mounts
+        return (stx.stx_attributes & STATX_ATTR_MOUNT_ROOT) != 0;
+#endif
+    char parent[PATH_MAX];
+    struct stat st, parent_st;
+    snprintf(parent, sizeof(parent), "%s/..", path);
+    if (stat(path, &st) < 0 || stat(parent, &parent_st) < 0)
+        return 0;
+    return st.st_dev != parent_st.st_dev || st.st_ino == parent_st.st_ino;  // different filesystem or /
+}
+
+/**
+ * @brief Checks if the kernel cmdline has the parameter
+ * 
+ * @param arg name or name=value
+ * @return uint8_t 1 if it has
+ */
+static uint8_t cmdlineHas(const char* arg) {
+    char key[256];
+    char value[256];
+    const char* eq = strchr(arg, '=');
+    size_t keylen = eq ? (size_t)(eq - arg) : strlen(arg);
+    if (keylen >= sizeof(key))
+        return 0;
+    memcpy(key, arg, keylen);
+    key[keylen] = '\0';
+
+    if (util_cmdlineGet(key, value, sizeof(value)) != EXIT_SUCCESS)
+        return 0;
+    return !eq || strcmp(value, eq + 1) == 0;
+}
+
+/**
+ * @brief Checks if running in the virtualization
+ * 
+ * @param arg yes, vm, container or id eg. kvm, docker
+ * @return uint8_t 1 if running in it
+ */
+static uint8_t virtualizationIs(const char* arg) {
+    detectVirtualization();
+    if (virt.kind == VIRT_NONE)
+        return 0;
+    if (strcmp(arg, "yes") == 0)
+        return 1;
+    if (strcmp(arg, "vm") == 0)
+        return virt.kind == VIRT_VM;
+    if (strcmp(arg, "container") == 0)
+        return virt.kind == VIRT_CONTAINER;
+    return strcmp(arg, virt.id) == 0;
+}
+
+/**
+ * @brief Checks if init runs in a container, can be used before anything is mounted
+ * Virtualization isn't cached here, VMs are detected later when /sys and /proc are mounted.
+ * @return uint8_t 1 if it does
+ */
+uint8_t condition_isContainer() {
+    return detectContainer() != NULL;
+}
+
+/**
+ * @brief Parses value of condition_* key
+ * 
+ * @param type CONDITION_*
+ * @param value value, prefixed with ! if the condition must be false
+ * @param out condition, its arg is allocated
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t condition_parse(uint8_t type, const char* value, struct condition* out) {
+    out->type = type;
+    out->negate = value[0] == '!';
+    if (out->negate)
+        value++;
+
+    if (*value == '\0')
+        return EXIT_FAILURE;
+    if ((type == CONDITION_PATH_EXISTS || type == CONDITION_MOUNTPOINT || type == CONDITION_FILE_NOT_EMPTY) && *value != '/')
+        return EXIT_FAILURE;  // paths must be absolute, init's cwd isn't defined
+
+    out->arg = strdup(value);
+    return out->arg ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Evaluates the condition in init, without spawning anything
+ * 
+ * @param c condition
+ * @return uint8_t 1 if it's satisfied, otherwise 0
+ */
+uint8_t condition_check(const struct condition* c) {
+    struct stat st;
+    uint8_t result = 0;
+
+    switch (c->type) {
+        case CONDITION_PATH_EXISTS:
+            result = access(c->arg, F_OK) == 0;
+            break;
+        case CONDITION_MOUNTPOINT:
+            result = isMountpoint(c->arg);
+            break;
+        case CONDITION_KERNEL_CMDLINE:
+            result = cmdlineHas(c->arg);
+            break;
+        case CONDITION_FILE_NOT_EMPTY:
+            result = stat(c->arg, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0;
+            break;
+        case CONDITION_VIRTUALIZATION:
+            result = virtualizationIs(c->arg);
+            break;
+    }
+    return result != c->negate;
+}
+
+/**
+ * @brief Returns name of the condition as written in configuration file
+ * 
+ * @param type CONDITION_*
+ * @return const char* name
+ */
+const char* condition_name(uint8_t type) {
+    return type < sizeof(names) / sizeof(names[0]) ? names[type] : "condition";
+}
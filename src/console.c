@@ -8,16 +8,22 @@
  */
 #include "console.h"
 
+#include <fcntl.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "config.h"
+#include "metrics.h"
 
 const char* ANSI_CLEARSCREEN = "\033[2J\033[1;1H";
 
+static uint8_t use_stdout = 0;  // 1 in container mode, messages go to stdout
+static uint8_t use_colors = 1;
+
 /**
  * @brief Multiple print in one function
  * 
@@ -27,13 +33,16 @@ const char* ANSI_CLEARSCREEN = "\033[2J\033[1;1H";
  * @return uint8_t 
  */
 static uint8_t printMulti(const uint8_t type, const char* text, va_list message) {
-    FILE* f = fopen(MSG_CONSOLE, "w");
+    FILE* f = use_stdout ? stdout : fopen(MSG_CONSOLE, "w");
     if (f) {
         uint8_t hdrsize = sizeof(COLOR_GRN) + sizeof("quickInit: ") + +sizeof(COLOR_WHT) + sizeof(COLOR_NO);
         char* buf = (char*)malloc((strlen(text) + 1 + hdrsize) * sizeof(char));
 
         if (type == 0) {
             vfprintf(f, text, message);
+        } else if (!use_colors) {
+            sprintf(buf, "quickInit: %s", text);
+            vfprintf(f, buf, message);
         } else if (type == 1) {
             sprintf(buf, COLOR_GRN "quick" COLOR_WHT "Init: " COLOR_NO "%s", text);
             vfprintf(f, buf, message);
@@ -44,12 +53,26 @@ static uint8_t printMulti(const uint8_t type, const char* text, va_list message)
             sprintf(buf, COLOR_CYA "quick" COLOR_WHT "Init: " COLOR_NO "%s", text);
             vfprintf(f, buf, message);
         }
-        fclose(f);
+        if (use_stdout)
+            fflush(f);
+        else
+            fclose(f);
         free(buf);
 
         return EXIT_SUCCESS;
-    } else
+    } else {
+        metrics_inc(METRICS_CONSOLE_DROPPED);
         return EXIT_FAILURE;
+    }
+}
+
+/**
+ * @brief Sends messages to stdout instead of MSG_CONSOLE, used in container mode
+ * Colors are used only if stdout is a terminal.
+ */
+void console_useStdout() {
+    use_stdout = 1;
+    use_colors = isatty(STDOUT_FILENO);
 }
 
 /**
@@ -151,11 +174,11 @@ void console_clearScreen() {
  * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
  */
 uint8_t console_clearTty(char* tty) {
-    FILE* f = fopen(tty, "w");
-    if (f) {
-        fprintf(f, ANSI_CLEARSCREEN);
-        fclose(f);
-        return EXIT_SUCCESS;
+    int fd = open(tty, O_WRONLY | O_NOCTTY | O_CLOEXEC);  // no stdio, it runs before every tty respawn
+    if (fd >= 0) {
+        ssize_t written = write(fd, ANSI_CLEARSCREEN, strlen(ANSI_CLEARSCREEN));
+        close(fd);
+        return written < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
     } else
         return EXIT_FAILURE;
 }
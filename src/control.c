@@ -0,0 +1,255 @@
+/**
+ * @file control.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#define _GNU_SOURCE
+#include "control.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "console.h"
+#include "loop.h"
+#include "svc.h"
+#include "utilities.h"
+
+/*! \cond PRIVATE */
+#define WAIT_NONE 0
+#define WAIT_BOOT 1
+#define WAIT_SERVICE 2
+/*! \endcond */
+
+/**
+ * @brief Connected client, it sends one request and is disconnected after the reply
+ * 
+ */
+struct control_client {
+    int fd;
+    uint8_t wait;                    // WAIT_*, what the client is subscribed to
+    char name[SERVICENAME_MAXLEN];  // service for WAIT_SERVICE
+};
+
+static struct control_client clients[CONTROL_MAXCLIENTS];
+static size_t client_count = 0;
+static size_t service_waits = 0;  // clients waiting for a service, state changes are free without them
+static uint8_t boot_complete = 0;
+
+/**
+ * @brief Disconnects the client
+ * 
+ * @param i index of the client
+ */
+static void dropClient(size_t i) {
+    if (clients[i].wait == WAIT_SERVICE)
+        service_waits--;
+    loop_removeFd(clients[i].fd);
+    close(clients[i].fd);
+    clients[i] = clients[--client_count];
+}
+
+/**
+ * @brief Sends reply and disconnects the client
+ * 
+ * @param i index of the client
+ * @param msg reply
+ */
+static void replyAndDrop(size_t i, const char *msg) {
+    send(clients[i].fd, msg, strlen(msg), MSG_DONTWAIT | MSG_NOSIGNAL);
+    dropClient(i);
+}
+
+/**
+ * @brief Decides whether the service is up
+ * 
+ * @param name name of the service
+ * @param buf buffer for the reply
+ * @param size size of the buffer
+ * @return const char* reply or NULL if the client must wait
+ */
+static const char *serviceReply(const char *name, char *buf, size_t size) {
+    uint8_t state;
+    int exit_code, exit_signal;
+    if (svc_getState(name, &state, &exit_code, &exit_signal) != EXIT_SUCCESS)
+        return CONTROL_FAILED "no such service";
+
+    switch (state) {
+        case SERVICE_STARTED:
+            if (exit_signal != 0)
+                snprintf(buf, size, CONTROL_FAILED "start script was killed by signal %d", exit_signal);
+            else if (exit_code != 0)
+                snprintf(buf, size, CONTROL_FAILED "start script exited with code %d", exit_code);
+            else
+                return CONTROL_OK;
+            return buf;
+        case SERVICE_LISTENING:
+        case SERVICE_SCHEDULED:
+            return CONTROL_OK;
+        case SERVICE_TIMEDOUT:
+            return CONTROL_FAILED "start script timed out";
+        case SERVICE_CONDITION_FAILED:
+            return CONTROL_FAILED "condition isn't met";
+        default:  // stopped or starting, it can be started later
+            return NULL;
+    }
+}
+
+/**
+ * @brief Freezes or thaws the service or group
+ * 
+ * @param target name of the service or group
+ * @param freeze 1 freezes, 0 thaws
+ * @return const char* reply
+ */
+static const char *freezeReply(const char *target, uint8_t freeze) {
+    int changed = svc_freeze(target, freeze);
+    if (changed < 0)
+        return CONTROL_FAILED "no such service or group";
+    if (changed == 0)
+        return freeze ? CONTROL_FAILED "nothing to freeze, services must be running in their cgroups" : CONTROL_FAILED "nothing is frozen";
+    return CONTROL_OK;
+}
+
+/**
+ * @brief Searches client by its socket
+ * 
+ * @param fd socket of the client
+ * @return size_t index of the client, client_count if it isn't found
+ */
+static size_t findClient(int fd) {
+    size_t i = 0;
+    while (i < client_count && clients[i].fd != fd)
+        i++;
+    return i;
+}
+
+/**
+ * @brief Reads request of the client, answers it at once or subscribes the client
+ * 
+ * @param fd socket of the client
+ * @param events unused
+ * @param data unused
+ */
+static void clientReadable(int fd, uint32_t events, void *data) {
+    size_t i = findClient(fd);
+    if (i == client_count)
+        return;
+
+    char msg[CONTROL_MAXMSG];
+    ssize_t len = recv(fd, msg, sizeof(msg) - 1, MSG_DONTWAIT);
+    if (len < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (len <= 0 || clients[i].wait != WAIT_NONE) {  // hung up, or more than one request
+        dropClient(i);
+        return;
+    }
+    msg[len] = '\0';
+
+    char reply[CONTROL_MAXMSG];
+    if (strcmp(msg, CONTROL_WAIT_BOOT) == 0) {
+        if (boot_complete)
+            replyAndDrop(i, CONTROL_OK);
+        else
+            clients[i].wait = WAIT_BOOT;
+    } else if (strncmp(msg, CONTROL_WAIT_SERVICE, strlen(CONTROL_WAIT_SERVICE)) == 0) {
+        const char *name = msg + strlen(CONTROL_WAIT_SERVICE);
+        const char *r = serviceReply(name, reply, sizeof(reply));
+        if (r) {
+            replyAndDrop(i, r);
+        } else {
+            clients[i].wait = WAIT_SERVICE;
+            snprintf(clients[i].name, sizeof(clients[i].name), "%.*s", SERVICENAME_MAXLEN - 1, name);
+            service_waits++;
+        }
+    } else if (strncmp(msg, CONTROL_FREEZE, strlen(CONTROL_FREEZE)) == 0) {
+        replyAndDrop(i, freezeReply(msg + strlen(CONTROL_FREEZE), 1));
+    } else if (strncmp(msg, CONTROL_THAW, strlen(CONTROL_THAW)) == 0) {
+        replyAndDrop(i, freezeReply(msg + strlen(CONTROL_THAW), 0));
+    } else {
+        replyAndDrop(i, CONTROL_FAILED "unknown request");
+    }
+}
+
+/**
+ * @brief Accepts new client
+ * 
+ * @param fd listening socket
+ * @param events unused
+ * @param data unused
+ */
+static void acceptClient(int fd, uint32_t events, void *data) {
+    int client = accept4(fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (client < 0)
+        return;
+    if (client_count == CONTROL_MAXCLIENTS || loop_addFd(client, EPOLLIN, clientReadable, NULL) != EXIT_SUCCESS) {
+        close(client);
+        return;
+    }
+    clients[client_count++] = (struct control_client){.fd = client, .wait = WAIT_NONE};
+}
+
+/**
+ * @brief Creates control socket served by the event loop
+ * 
+ */
+void control_init() {
+    util_dirCreate(RUN_DIR, 0755);
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (sock < 0) {
+        console_error("failed creating control socket\r\n");
+        return;
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, CONTROL_SOCKET, sizeof(addr.sun_path) - 1);
+    unlink(CONTROL_SOCKET);
+
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, CONTROL_MAXCLIENTS) < 0 ||
+        loop_addFd(sock, EPOLLIN, acceptClient, NULL) != EXIT_SUCCESS) {
+        console_error("failed binding %s\r\n", CONTROL_SOCKET);
+        close(sock);
+    }
+}
+
+/**
+ * @brief Boot is finished, answers clients waiting for it
+ * 
+ */
+void control_bootComplete() {
+    boot_complete = 1;
+    for (size_t i = client_count; i-- > 0;) {
+        if (clients[i].wait == WAIT_BOOT)
+            replyAndDrop(i, CONTROL_OK);
+    }
+}
+
+/**
+ * @brief State of the service has changed, answers clients waiting for it
+ * 
+ * @param name name of the service
+ */
+void control_serviceChanged(const char *name) {
+    if (service_waits == 0)
+        return;
+
+    char reply[CONTROL_MAXMSG];
+    for (size_t i = client_count; i-- > 0;) {
+        if (clients[i].wait != WAIT_SERVICE || strcmp(clients[i].name, name) != 0)
+            continue;
+        const char *r = serviceReply(name, reply, sizeof(reply));
+        if (r)
+            replyAndDrop(i, r);
+    }
+}
@@ -0,0 +1,143 @@
+/**
+ * @file history.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "history.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "console.h"
+#include "svc.h"
+#include "utilities.h"
+
+/**
+ * @brief Header of HISTORY_FILE, followed by count entries
+ * 
+ */
+struct history_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+};
+
+/**
+ * @brief Learned start duration of a service
+ * 
+ */
+struct history_entry {
+    uint32_t hash;  // FNV-1a hash of the name, compared before the name
+    float seconds;
+    char name[SERVICENAME_MAXLEN];
+};
+
+static struct history_entry entries[HISTORY_MAXENTRIES];
+static uint8_t used[HISTORY_MAXENTRIES];  // 1 if the service exists, others aren't saved
+static size_t entry_count = 0;
+
+/**
+ * @brief Searches entry of the service
+ * 
+ * @param name name of the service
+ * @return struct history_entry* entry or NULL
+ */
+static struct history_entry* find(const char* name) {
+    uint32_t hash = util_hashName(name);
+    for (size_t i = 0; i < entry_count; i++) {
+        if (entries[i].hash == hash && strcmp(entries[i].name, name) == 0) {  // names of services can collide
+            used[i] = 1;
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Reads durations learned in previous boots from HISTORY_FILE, missing file is empty history
+ * 
+ */
+void history_load() {
+    int fd = open(HISTORY_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct history_header header;
+    if (read(fd, &header, sizeof(header)) == sizeof(header) && header.magic == HISTORY_MAGIC && header.version == HISTORY_VERSION) {
+        size_t count = header.count < HISTORY_MAXENTRIES ? header.count : HISTORY_MAXENTRIES;
+        ssize_t len = read(fd, entries, count * sizeof(struct history_entry));
+        entry_count = len > 0 ? (size_t)len / sizeof(struct history_entry) : 0;  // truncated file keeps whole entries
+        for (size_t i = 0; i < entry_count; i++)
+            entries[i].name[sizeof(entries[i].name) - 1] = '\0';
+    }
+    close(fd);
+}
+
+/**
+ * @brief Returns learned start duration of the service
+ * 
+ * @param name name of the service
+ * @return double duration [seconds], 0 if it isn't known
+ */
+double history_get(const char* name) {
+    struct history_entry* e = find(name);
+    return e ? e->seconds : 0;
+}
+
+/**
+ * @brief Learns from a successful start of the service
+ * 
+ * @param name name of the service
+ * @param seconds duration of the start script
+ */
+void history_record(const char* name, double seconds) {
+    struct history_entry* e = find(name);
+    if (e) {
+        e->seconds += HISTORY_WEIGHT * (seconds - e->seconds);
+        return;
+    }
+    if (entry_count == HISTORY_MAXENTRIES)
+        return;
+    used[entry_count] = 1;
+    entries[entry_count].hash = util_hashName(name);
+    snprintf(entries[entry_count].name, sizeof(entries[entry_count].name), "%s", name);
+    entries[entry_count++].seconds = seconds;
+}
+
+/**
+ * @brief Writes durations of existing services to HISTORY_FILE, replaces it atomically
+ * It's called when boot is finished, a read-only root is silently skipped.
+ */
+void history_save() {
+    struct history_entry out[HISTORY_MAXENTRIES];
+    struct history_header header = {HISTORY_MAGIC, HISTORY_VERSION, 0};
+    for (size_t i = 0; i < entry_count; i++) {
+        if (used[i])
+            out[header.count++] = entries[i];
+    }
+
+    util_dirCreate(STATE_DIR, 0755);
+    int fd = open(HISTORY_FILE ".tmp", O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        if (errno != EROFS)
+            console_error("failed writing %s: %s\r\n", HISTORY_FILE, strerror(errno));
+        return;
+    }
+    size_t size = header.count * sizeof(struct history_entry);
+    uint8_t ok = write(fd, &header, sizeof(header)) == sizeof(header) && write(fd, out, size) == (ssize_t)size;
+    close(fd);
+    if (!ok || rename(HISTORY_FILE ".tmp", HISTORY_FILE) < 0) {
+        console_error("failed writing %s: %s\r\n", HISTORY_FILE, strerror(errno));
+        unlink(HISTORY_FILE ".tmp");
+    }
+}
@@ -0,0 +1,324 @@
+/**
+ * @file initramfs.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "initramfs.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/magic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "console.h"
+#include "recorder.h"
+#include "timeline.h"
+#include "trace.h"
+#include "utilities.h"
+
+/*! \cond PRIVATE */
+#define POLL_INTERVAL_NS 20000000  // 20 ms between checks for the root device
+/*! \endcond */
+
+/**
+ * @brief Filesystems moved into the real root, submounts like /dev/pts move with them
+ * 
+ */
+static const char *moved_mounts[] = {"/run", "/sys", "/proc", "/dev"};  // console is in /dev
+
+/**
+ * @brief Checks if init runs from an initramfs which should switch to the root= device
+ * 
+ * @return uint8_t 1 if / is the initramfs and root= is given
+ */
+uint8_t initramfs_isActive() {
+    struct statfs st;
+    char root[8];
+    if (statfs("/", &st) < 0 || (st.f_type != RAMFS_MAGIC && st.f_type != TMPFS_MAGIC))
+        return 0;
+    return util_cmdlineGet("root", root, sizeof(root)) == EXIT_SUCCESS;
+}
+
+/**
+ * @brief Waits for the path, devtmpfs and sysfs create it when the driver finds the device
+ * 
+ * @param path path to wait for
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE after INITRAMFS_ROOT_TIMEOUT
+ */
+static uint8_t waitForPath(const char *path) {
+    double deadline = util_monotonicTime() + INITRAMFS_ROOT_TIMEOUT;
+    uint8_t announced = 0;
+    while (access(path, F_OK) != 0) {
+        if (util_monotonicTime() > deadline)
+            return EXIT_FAILURE;
+        if (!announced) {
+            console_info("waiting for %s\r\n", path);
+            announced = 1;
+        }
+        struct timespec interval = {.tv_sec = 0, .tv_nsec = POLL_INTERVAL_NS};
+        nanosleep(&interval, NULL);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Waits for the root device
+ * Device paths and major:minor numbers are supported, for numbers /dev/root is created like the kernel does.
+ * @param root value of root=
+ * @param device output, path of the device
+ * @param size size of the output
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t findRoot(const char *root, char *device, size_t size) {
+    unsigned int major, minor;
+    char end;
+    if (root[0] == '/') {
+        snprintf(device, size, "%s", root);
+        return waitForPath(device);
+    }
+    if (sscanf(root, "%u:%u%c", &major, &minor, &end) != 2) {
+        console_error("root=%s isn't supported\r\n", root);
+        return EXIT_FAILURE;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/dev/block/%u:%u", major, minor);
+    snprintf(device, size, "/dev/root");
+    if (waitForPath(path) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    unlink(device);
+    return mknod(device, S_IFBLK | 0600, makedev(major, minor)) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Mounts the root device on INITRAMFS_NEWROOT
+ * Uses rootfstype=, rootflags= and rw like the kernel, without rootfstype= every
+ * filesystem which needs a device is tried.
+ * @param device path of the device
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t mountRoot(const char *device) {
+    char fstype[64], flags[256], unused[8];
+    unsigned long mountflags = util_cmdlineGet("rw", unused, sizeof(unused)) == EXIT_SUCCESS ? 0 : MS_RDONLY;
+    const char *data = util_cmdlineGet("rootflags", flags, sizeof(flags)) == EXIT_SUCCESS ? flags : NULL;
+
+    util_dirCreate(INITRAMFS_NEWROOT, 0755);
+    if (util_cmdlineGet("rootfstype", fstype, sizeof(fstype)) == EXIT_SUCCESS)
+        return mount(device, INITRAMFS_NEWROOT, fstype, mountflags, data) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    FILE *fp = fopen("/proc/filesystems", "r");
+    if (!fp)
+        return EXIT_FAILURE;
+    char line[128];
+    uint8_t ret = EXIT_FAILURE;
+    while (ret != EXIT_SUCCESS && fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "nodev", 5) == 0)
+            continue;
+        line[strcspn(line, "\n")] = '\0';
+        const char *type = line + strspn(line, " \t");
+        if (mount(device, INITRAMFS_NEWROOT, type, mountflags, data) == 0)
+            ret = EXIT_SUCCESS;
+    }
+    fclose(fp);
+    return ret;
+}
+
+/**
+ * @brief Deletes contents of the initramfs to free its memory, other filesystems are skipped
+ * 
+ * @param dirfd directory, closed by the function
+ * @param dev device of the initramfs
+ */
+static void deleteContents(int dirfd, dev_t dev) {
+    DIR *dir = fdopendir(dirfd);
+    if (!dir) {
+        close(dirfd);
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        struct stat st;
+        if (fstatat(dirfd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0 || st.st_dev != dev)
+            continue;
+        if (S_ISDIR(st.st_mode)) {
+            int fd = openat(dirfd, entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (fd >= 0)
+                deleteContents(fd, dev);
+            unlinkat(dirfd, entry->d_name, AT_REMOVEDIR);
+        } else {
+            unlinkat(dirfd, entry->d_name, 0);
+        }
+    }
+    closedir(dir);
+}
+
+/**
+ * @brief Checks that init of the new root is executable, symlinks are resolved inside the new root
+ * 
+ * @param init path of init in the new root
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t checkInit(const char *init) {
+    pid_t pid = fork();
+    if (pid < 0)
+        return EXIT_FAILURE;
+    if (pid == 0)  // chroot only in the child, the initramfs stays untouched
+        _exit(chroot(INITRAMFS_NEWROOT) == 0 && chdir("/") == 0 && access(init, X_OK) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR)
+            return EXIT_FAILURE;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Checks the new root before anything is changed, the initramfs stays usable when it fails
+ * 
+ * @param rootfd initramfs
+ * @param init path of init in the new root
+ * @param mounted 1 for every moved filesystem which is mounted
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t checkNewRoot(int rootfd, const char *init, const uint8_t *mounted) {
+    struct stat root_st, st;
+    char path[sizeof(INITRAMFS_NEWROOT) + PATH_MAX];
+
+    if (fstat(rootfd, &root_st) < 0 || stat(INITRAMFS_NEWROOT, &st) < 0 || st.st_dev == root_st.st_dev) {
+        console_error("%s isn't a mounted filesystem\r\n", INITRAMFS_NEWROOT);
+        return EXIT_FAILURE;
+    }
+    if (checkInit(init) != EXIT_SUCCESS) {
+        console_error("%s isn't executable in the new root\r\n", init);
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < sizeof(moved_mounts) / sizeof(moved_mounts[0]); i++) {
+        snprintf(path, sizeof(path), INITRAMFS_NEWROOT "%s", moved_mounts[i]);
+        util_dirCreate(path, 0755);
+        if (mounted[i] && (stat(path, &st) < 0 || !S_ISDIR(st.st_mode))) {  // read-only root must have it
+            console_error("%s is missing in the new root\r\n", moved_mounts[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Moves base filesystems into the new root, on failure the moved ones are moved back
+ * 
+ * @param mounted 1 for every moved filesystem which is mounted
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t moveMounts(const uint8_t *mounted) {
+    char path[sizeof(INITRAMFS_NEWROOT) + PATH_MAX];
+
+    for (size_t i = 0; i < sizeof(moved_mounts) / sizeof(moved_mounts[0]); i++) {
+        snprintf(path, sizeof(path), INITRAMFS_NEWROOT "%s", moved_mounts[i]);
+        if (!mounted[i] || mount(moved_mounts[i], path, NULL, MS_MOVE, NULL) == 0)
+            continue;
+        console_error("failed moving %s: %s\r\n", moved_mounts[i], strerror(errno));
+        while (i-- > 0) {  // console is in /dev, which is moved last
+            snprintf(path, sizeof(path), INITRAMFS_NEWROOT "%s", moved_mounts[i]);
+            if (mounted[i])
+                mount(path, moved_mounts[i], NULL, MS_MOVE, NULL);
+        }
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Handles failure after the initramfs was deleted, there is nothing to return to
+ * A shell of the new root is executed if it can be entered, otherwise init exits and the kernel panics.
+ * @param what failed step
+ */
+static void switchFailed(const char *what) {
+    console_error("failed %s: %s, initramfs is already deleted\r\n", what, strerror(errno));
+    if (chroot(".") == 0 && chdir("/") == 0) {  // cwd is the new root
+        char *shell[] = {EMERGENCY_SHELL, NULL};
+        execv(shell[0], shell);
+    }
+    console_error("no shell to recover with, giving up\r\n");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Mounts the real root, moves base filesystems into it, deletes the initramfs,
+ * switches root and executes init of the real root, which restores the boot timeline
+ * Everything is checked before the initramfs is deleted, until then failures return to it.
+ * @param argv arguments of init, passed to the new one
+ */
+void initramfs_switchRoot(char *argv[]) {
+    double phase_start = util_monotonicTime();
+    char root[PATH_MAX], device[PATH_MAX], init[PATH_MAX];
+
+    util_cmdlineGet("root", root, sizeof(root));
+    if (util_cmdlineGet("init", init, sizeof(init)) != EXIT_SUCCESS)
+        snprintf(init, sizeof(init), "%s", INITRAMFS_INIT);
+    if (findRoot(root, device, sizeof(device)) != EXIT_SUCCESS) {
+        console_error("root device %s isn't available, staying in initramfs\r\n", root);
+        return;
+    }
+    if (mountRoot(device) != EXIT_SUCCESS) {
+        console_error("failed mounting %s: %s, staying in initramfs\r\n", device, strerror(errno));
+        return;
+    }
+
+    struct stat st;
+    int rootfd = open("/", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (rootfd < 0 || fstat(rootfd, &st) < 0) {
+        console_error("failed opening initramfs: %s\r\n", strerror(errno));
+        if (rootfd >= 0)
+            close(rootfd);
+        umount(INITRAMFS_NEWROOT);
+        return;
+    }
+
+    util_dirCreate("/run", 0755);  // timeline is carried over in /run
+    if (!util_isMounted("/run"))
+        mount("tmpfs", "/run", "tmpfs", MS_NODEV | MS_NOSUID | MS_NOEXEC, "mode=0755");
+    recorder_publish();  // events of the switch are kept too
+    uint8_t mounted[sizeof(moved_mounts) / sizeof(moved_mounts[0])];
+    for (size_t i = 0; i < sizeof(mounted); i++)  // before /proc is moved away
+        mounted[i] = util_isMounted((char *)moved_mounts[i]);
+
+    if (checkNewRoot(rootfd, init, mounted) != EXIT_SUCCESS || chdir(INITRAMFS_NEWROOT) < 0 || moveMounts(mounted) != EXIT_SUCCESS) {
+        console_error("staying in initramfs\r\n");
+        chdir("/");
+        close(rootfd);
+        umount(INITRAMFS_NEWROOT);
+        return;
+    }
+
+    deleteContents(rootfd, st.st_dev);  // point of no return
+    if (mount(".", "/", NULL, MS_MOVE, NULL) < 0)
+        switchFailed("moving the new root");
+    if (chroot(".") < 0 || chdir("/") < 0)
+        switchFailed("switching root");
+
+    timeline_add("phase", "initramfs", phase_start, util_monotonicTime(), NULL);
+    timeline_handoff();
+    TRACE(switch_root, device, init);
+    argv[0] = init;
+    execv(init, argv);
+    console_error("failed executing %s: %s, continuing in the real root\r\n", init, strerror(errno));
+    unlink(TIMELINE_HANDOFF);
+}
@@ -0,0 +1,376 @@
+/**
+ * @file loop.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "loop.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "console.h"
+#include "utilities.h"
+
+/**
+ * @brief Maximum number of tick callbacks
+ * 
+ */
+#define LOOP_MAXTICKS 8
+
+/**
+ * @brief Watched file descriptor
+ * 
+ */
+struct loop_watcher {
+    int fd;
+    loop_callback cb;
+    void* data;
+    struct loop_watcher* next;
+};
+
+/**
+ * @brief One shot timer in the timer wheel
+ * 
+ */
+struct loop_timer {
+    uint64_t expires;  // wheel tick at which it fires
+    loop_timerCallback cb;
+    void* data;
+    struct loop_timer* next;
+    struct loop_timer** pprev;  // pointer which points to this timer, for unlinking
+};
+
+static int epoll_fd = -1;
+static struct loop_watcher* watchers = NULL;  // list of all watchers, removed ones have fd == -1
+static uint8_t watchers_dead = 0;             // set when a watcher waits for being freed
+
+static void (*ticks[LOOP_MAXTICKS])();
+static uint8_t tick_count = 0;
+
+/**
+ * @brief Hierarchical timer wheel, level L has slots of LOOP_WHEEL_SIZE^L wheel ticks
+ * Timers cascade to lower levels as the time comes closer, so adding, cancelling
+ * and firing is O(1). All timers share one timerfd armed at the nearest expiry.
+ */
+static struct loop_timer* wheel[LOOP_WHEEL_LEVELS][LOOP_WHEEL_SIZE];
+static uint64_t wheel_now = 0;      // last processed wheel tick
+static double wheel_origin = 0;     // monotonic time of wheel tick 0
+static uint64_t wheel_armed = 0;    // tick at which timer_fd fires, 0 if disarmed
+static size_t timer_count = 0;
+static int timer_fd = -1;
+
+static void wheelExpired(int fd, uint32_t events, void* data);
+static void tickTimer(void* data);
+
+/**
+ * @brief Creates epoll instance
+ * 
+ */
+void loop_init() {
+    static uint8_t initialized = 0;
+    if (initialized)
+        return;
+    initialized = 1;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0)
+        console_error("failed creating event loop: %s\r\n", strerror(errno));
+
+    wheel_origin = util_monotonicTime();
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0 || loop_addFd(timer_fd, EPOLLIN, wheelExpired, NULL) != EXIT_SUCCESS)
+        console_error("failed creating timer: %s\r\n", strerror(errno));
+    loop_addTimer(LOOP_TICK_MS / 1000.0, tickTimer, NULL);
+}
+
+/**
+ * @brief Watch a file descriptor
+ * 
+ * @param fd file descriptor
+ * @param events EPOLLIN, EPOLLOUT etc.
+ * @param cb function called when fd is ready
+ * @param data pointer passed to the callback
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t loop_addFd(int fd, uint32_t events, loop_callback cb, void* data) {
+    loop_init();
+
+    struct loop_watcher* w = (struct loop_watcher*)malloc(sizeof(struct loop_watcher));
+    if (!w)
+        return EXIT_FAILURE;
+
+    w->fd = fd;
+    w->cb = cb;
+    w->data = data;
+
+    struct epoll_event ev = {.events = events, .data.ptr = w};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        console_error("failed watching fd %d: %s\r\n", fd, strerror(errno));
+        free(w);
+        return EXIT_FAILURE;
+    }
+
+    w->next = watchers;
+    watchers = w;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Stop watching a file descriptor, it is safe to call from a callback
+ * 
+ * @param fd file descriptor
+ */
+void loop_removeFd(int fd) {
+    for (struct loop_watcher* w = watchers; w != NULL; w = w->next) {
+        if (w->fd == fd) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            w->fd = -1;  // freed after the current pass, events may still point to it
+            watchers_dead = 1;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Register function called every LOOP_TICK_MS
+ * 
+ * @param tick function
+ */
+void loop_addTick(void (*tick)()) {
+    if (tick_count < LOOP_MAXTICKS)
+        ticks[tick_count++] = tick;
+}
+
+/**
+ * @brief Puts timer to the slot of the wheel where it belongs
+ * 
+ * @param t timer, expires isn't before wheel_now
+ */
+static void wheelInsert(struct loop_timer* t) {
+    const uint64_t range = 1ull << (LOOP_WHEEL_BITS * LOOP_WHEEL_LEVELS);
+    uint64_t expires = t->expires - wheel_now < range ? t->expires : wheel_now + range - 1;  // far timers cascade again
+    uint64_t delta = expires - wheel_now;
+
+    uint8_t level = 0;
+    while (level < LOOP_WHEEL_LEVELS - 1 && delta >= 1ull << (LOOP_WHEEL_BITS * (level + 1)))
+        level++;
+
+    struct loop_timer** slot = &wheel[level][(expires >> (LOOP_WHEEL_BITS * level)) & (LOOP_WHEEL_SIZE - 1)];
+    t->next = *slot;
+    if (t->next)
+        t->next->pprev = &t->next;
+    t->pprev = slot;
+    *slot = t;
+}
+
+/**
+ * @brief Removes timer from its slot
+ * 
+ * @param t timer
+ */
+static void wheelUnlink(struct loop_timer* t) {
+    *t->pprev = t->next;
+    if (t->next)
+        t->next->pprev = t->pprev;
+}
+
+/**
+ * @brief Finds the nearest expiry, in every level only the current slot and the first used one after it can have it
+ * The current slot of a level holds only timers which wrapped around it, so later slots can expire earlier.
+ * @return uint64_t wheel tick or 0 if there are no timers
+ */
+static uint64_t wheelNextExpiry() {
+    uint64_t next = 0;
+    for (uint8_t level = 0; level < LOOP_WHEEL_LEVELS; level++) {
+        uint64_t index = wheel_now >> (LOOP_WHEEL_BITS * level);
+        for (uint64_t i = 0; i < LOOP_WHEEL_SIZE; i++) {
+            struct loop_timer* head = wheel[level][(index + i) & (LOOP_WHEEL_SIZE - 1)];
+            for (struct loop_timer* t = head; t != NULL; t = t->next) {
+                if (next == 0 || t->expires < next)
+                    next = t->expires;
+            }
+            if (head && i > 0)
+                break;
+        }
+    }
+    return next;
+}
+
+/**
+ * @brief Arms timerfd at the nearest expiry, only when it is earlier than the armed one
+ * 
+ * @param force 1 if the armed expiry is no longer valid
+ */
+static void wheelArm(uint8_t force) {
+    uint64_t next = wheelNextExpiry();
+    if (!force && wheel_armed != 0 && wheel_armed <= next)
+        return;
+
+    struct itimerspec its = {0};
+    if (next != 0) {
+        double at = wheel_origin + next * (LOOP_WHEEL_RES_MS / 1000.0);
+        its.it_value.tv_sec = (time_t)at;
+        its.it_value.tv_nsec = (long)((at - (time_t)at) * 1e9) + 1;  // never zero, it would disarm
+    }
+    wheel_armed = next;
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/**
+ * @brief Advances the wheel by one tick, cascades higher levels and fires expired timers
+ * 
+ */
+static void wheelStep() {
+    wheel_now++;
+    for (uint8_t level = 1; level < LOOP_WHEEL_LEVELS; level++) {
+        if ((wheel_now & ((1ull << (LOOP_WHEEL_BITS * level)) - 1)) != 0)
+            break;  // lower level hasn't wrapped
+        struct loop_timer** slot = &wheel[level][(wheel_now >> (LOOP_WHEEL_BITS * level)) & (LOOP_WHEEL_SIZE - 1)];
+        struct loop_timer* t = *slot;
+        *slot = NULL;
+        while (t) {
+            struct loop_timer* next = t->next;
+            wheelInsert(t);
+            t = next;
+        }
+    }
+
+    struct loop_timer** slot = &wheel[0][wheel_now & (LOOP_WHEEL_SIZE - 1)];
+    while (*slot) {  // callbacks may add and cancel timers, so the head is read again
+        struct loop_timer* t = *slot;
+        wheelUnlink(t);
+        timer_count--;
+        t->cb(t->data);
+        free(t);
+    }
+}
+
+/**
+ * @brief timerfd expired, processes all ticks which have passed
+ * 
+ * @param fd timerfd
+ * @param events unused
+ * @param data unused
+ */
+static void wheelExpired(int fd, uint32_t events, void* data) {
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        return;
+
+    uint64_t target = (uint64_t)((util_monotonicTime() - wheel_origin) * 1000 / LOOP_WHEEL_RES_MS + 1e-6);  // armed time may be rounded down
+    while (wheel_now < target) {
+        if (timer_count == 0) {  // nothing can fire, jump
+            wheel_now = target;
+            break;
+        }
+        wheelStep();
+    }
+    wheelArm(1);
+}
+
+/**
+ * @brief Runs tick callbacks and schedules the next tick
+ * 
+ * @param data unused
+ */
+static void tickTimer(void* data) {
+    loop_addTimer(LOOP_TICK_MS / 1000.0, tickTimer, NULL);
+    for (uint8_t i = 0; i < tick_count; i++)
+        ticks[i]();
+}
+
+/**
+ * @brief Calls function once after the timeout
+ * Timers are rounded up to LOOP_WHEEL_RES_MS and share one timerfd.
+ * @param seconds timeout
+ * @param cb function
+ * @param data pointer passed to the function
+ * @return struct loop_timer* timer, invalid after it expires or is cancelled, NULL on failure
+ */
+struct loop_timer* loop_addTimer(double seconds, loop_timerCallback cb, void* data) {
+    loop_init();
+
+    struct loop_timer* timer = (struct loop_timer*)malloc(sizeof(struct loop_timer));
+    if (!timer)
+        return NULL;
+
+    double at = (util_monotonicTime() - wheel_origin + (seconds > 0 ? seconds : 0)) * 1000 / LOOP_WHEEL_RES_MS;
+    timer->expires = (uint64_t)at;
+    if (timer->expires < at)  // rounded up, so it never fires early
+        timer->expires++;
+    if (timer->expires <= wheel_now)
+        timer->expires = wheel_now + 1;
+    timer->cb = cb;
+    timer->data = data;
+    wheelInsert(timer);
+    timer_count++;
+    wheelArm(0);
+    return timer;
+}
+
+/**
+ * @brief Cancels timer which hasn't expired yet
+ * 
+ * @param timer timer, ignored if NULL
+ */
+void loop_cancelTimer(struct loop_timer* timer) {
+    if (!timer)
+        return;
+    wheelUnlink(timer);
+    timer_count--;
+    free(timer);  // timerfd stays armed, the spurious wakeup is cheaper than searching the wheel
+}
+
+/**
+ * @brief Frees removed watchers
+ * 
+ */
+static void sweepWatchers() {
+    struct loop_watcher** w = &watchers;
+    while (*w != NULL) {
+        if ((*w)->fd < 0) {
+            struct loop_watcher* dead = *w;
+            *w = dead->next;
+            free(dead);
+        } else {
+            w = &(*w)->next;
+        }
+    }
+    watchers_dead = 0;
+}
+
+/**
+ * @brief Waits for events or expired timers and handles them
+ * 
+ */
+void loop_runOnce() {
+    loop_init();
+
+    struct epoll_event events[LOOP_MAXEVENTS];
+    int n = epoll_wait(epoll_fd, events, LOOP_MAXEVENTS, -1);  // the wheel wakes it up for ticks
+    for (int i = 0; i < n; i++) {
+        struct loop_watcher* w = (struct loop_watcher*)events[i].data.ptr;
+        if (w->fd >= 0)
+            w->cb(w->fd, events[i].events, w->data);
+    }
+
+    if (watchers_dead)
+        sweepWatchers();
+}
+
+/**
+ * @brief Runs the event loop forever
+ * 
+ */
+void loop_run() {
+    for (;;)
+        loop_runOnce();
+}
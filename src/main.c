@@ -11,17 +11,29 @@
 #include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/klog.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "condition.h"
 #include "config.h"
 #include "console.h"
+#include "control.h"
+#include "history.h"
+#include "initramfs.h"
+#include "loop.h"
+#include "metrics.h"
 #include "process.h"
+#include "recorder.h"
+#include "runlevel.h"
 #include "signals.h"
+#include "status.h"
 #include "svc.h"
+#include "timeline.h"
+#include "trace.h"
 #include "tty.h"
 #include "utilities.h"
 
@@ -33,6 +45,8 @@ static void mountBaseFs() {
     if (!util_isMounted("/proc") && mount("none", "/proc", "proc", MS_NODEV | MS_NOSUID | MS_NOEXEC, NULL)) {
         console_error("failed mounting /proc");
     }
+    if (!util_isMounted("/dev"))  // kernel doesn't mount devtmpfs in initramfs
+        mount("devtmpfs", "/dev", "devtmpfs", MS_NOSUID, "mode=0755");
     if (util_dirExists("/proc/bus/usb")) {
         mount("none", "/proc/bus/usb", "usbfs", 0, NULL);
     }
@@ -43,7 +57,8 @@ static void mountBaseFs() {
         console_error("failed mounting /sys");
     }
     util_dirCreate("/dev/pts", 0755);
-    mount("devpts", "/dev/pts", "devpts", 0, "gid=5,mode=620,ptmxmode=0666");
+    if (!util_isMounted("/dev/pts"))  // it's moved from initramfs
+        mount("devpts", "/dev/pts", "devpts", 0, "gid=5,mode=620,ptmxmode=0666");
 
     if (!util_isInFstab("/dev/shm") && !util_isMounted("/dev/shm")) {
         util_dirCreate("/dev/shm", 0755);
@@ -54,7 +69,47 @@ static void mountBaseFs() {
         mount("tmpfs", "/run", "tmpfs", MS_NODEV | MS_NOSUID | MS_NOEXEC, "mode=0755");
 }
 
-int main() {
+/**
+ * @brief Checks if init runs as container init
+ * --container and --no-container arguments override detection.
+ * @param argc number of arguments
+ * @param argv arguments
+ * @return uint8_t 1 in container mode
+ */
+static uint8_t isContainer(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--container") == 0)
+            return 1;
+        if (strcmp(argv[i], "--no-container") == 0)
+            return 0;
+    }
+    return CONTAINER_DETECT && condition_isContainer();
+}
+
+/**
+ * @brief Checks if ttys are started without waiting for services
+ * 
+ * @return uint8_t 1 in early console mode
+ */
+static uint8_t isEarlyConsole() {
+    char buf[8];
+    if (util_cmdlineGet("quickinit.early_console", buf, sizeof(buf)) != EXIT_SUCCESS)
+        return EARLY_CONSOLE;
+    return strcmp(buf, "0") != 0;  // quickinit.early_console without value enables it
+}
+
+/**
+ * @brief Starts ttys and records the phase
+ * 
+ */
+static void startTtys() {
+    double phase_start = util_monotonicTime();
+    tty_init();
+    metrics_setPhase(METRICS_PHASE_TTYS, util_monotonicTime() - phase_start);
+    timeline_add("phase", "ttys", phase_start, util_monotonicTime(), NULL);
+}
+
+int main(int argc, char* argv[]) {
     if (getuid() != 0) {
         printf("quickInit: only root can execute this\r\n");
         return EXIT_FAILURE;
@@ -64,9 +119,31 @@ int main() {
         return EXIT_FAILURE;
     }
 
-    signals_setup();
-    mountBaseFs();
-    klogctl(6, NULL, 0);  // SYSLOG_ACTION_CONSOLE_OFF=6 disable printing printk to console
+    recorder_init();  // crash of PID 1 panics the kernel, recorded events explain it
+
+    uint8_t container = isContainer(argc, argv);
+    if (container) {  // kernel is set up by the host, output goes to the container log
+        console_useStdout();
+        process_inheritStdio();
+    }
+
+    timeline_restore();  // boot started in initramfs
+
+    double phase_start = util_monotonicTime();
+    loop_init();
+    signals_setup(container);
+    if (!container)
+        mountBaseFs();
+    trace_init();  // needs /sys
+    metrics_setPhase(METRICS_PHASE_MOUNT, util_monotonicTime() - phase_start);
+    timeline_add("phase", "mount", phase_start, util_monotonicTime(), NULL);
+    if (!container && initramfs_isActive())
+        initramfs_switchRoot(argv);  // returns only when the real root can't be used
+    recorder_publish();  // needs /run
+    metrics_init();
+    control_init();  // clients can wait for services while they start
+    if (!container)
+        klogctl(6, NULL, 0);  // SYSLOG_ACTION_CONSOLE_OFF=6 disable printing printk to console
 
     console_printVersion();
 
@@ -75,11 +152,27 @@ int main() {
     setenv("PATH", "/bin:/sbin:/usr/bin:/usr/sbin:/usr/local/sbin:/usr/local/bin", 1);  // overwrite PATH env to default
     setlocale(LC_ALL, "");
 
-    svc_init();
-    svc_waitForAll();
-    tty_init();
+    runlevel_init();
+    status_init();
+
+    uint8_t early_console = isEarlyConsole() && !container;
+    phase_start = util_monotonicTime();
+    svc_init(container);
+    if (early_console) {  // hung start script doesn't leave the machine without console
+        svc_waitForConsole();
+        startTtys();
+    }
+    svc_waitForAll();  // ttys are respawned by the loop meanwhile
+    metrics_setPhase(METRICS_PHASE_SERVICES, util_monotonicTime() - phase_start);
+    timeline_add("phase", "services", phase_start, util_monotonicTime(), NULL);
+
+    if (!early_console && !container)  // container has no ttys
+        startTtys();
+    timeline_write();
+    control_bootComplete();
+    history_save();  // root is usually writable when services are started
 
-    process_spawnChildren();
+    loop_run();
 
     return EXIT_SUCCESS;
 }
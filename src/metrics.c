@@ -0,0 +1,229 @@
+/**
+ * @file metrics.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#define _GNU_SOURCE
+#include "metrics.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "console.h"
+#include "utilities.h"
+
+/**
+ * @brief Maximum size of the text exposition
+ * 
+ */
+#define METRICS_BUFSIZE 8192
+
+/**
+ * @brief Pause after accept fails for lack of descriptors or memory [seconds]
+ * 
+ */
+#define METRICS_ACCEPT_BACKOFF 1
+
+static const char* counter_names[METRICS_COUNTERS][2] = {
+    {"quickinit_spawns_total", "Processes forked by init"},
+    {"quickinit_exec_failures_total", "Children which failed to exec their program"},
+    {"quickinit_reaps_total", "Children reaped by init"},
+    {"quickinit_tty_respawns_total", "TTYs respawned after their process died"},
+    {"quickinit_backoffs_total", "TTY starts delayed by the respawn interval"},
+    {"quickinit_console_dropped_total", "Console messages which couldn't be written"},
+    {"quickinit_service_timeouts_total", "Service start/stop scripts killed after their timeout"},
+    {"quickinit_health_failures_total", "Failed service health checks"},
+    {"quickinit_job_runs_total", "Runs of periodic jobs"},
+};
+
+static const char* histogram_names[METRICS_HISTOGRAMS][2] = {
+    {"quickinit_service_start_seconds", "Duration of service start scripts"},
+    {"quickinit_service_stop_seconds", "Duration of service stop scripts"},
+};
+
+static const char* phase_names[METRICS_PHASES] = {"mount", "services", "ttys"};
+
+// upper bounds of histogram buckets in seconds, +Inf is implicit
+static const double buckets[] = {0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60};
+
+#define BUCKET_COUNT (sizeof(buckets) / sizeof(buckets[0]))
+
+/**
+ * @brief Histogram with cumulative buckets, sum is kept in microseconds
+ * 
+ */
+struct histogram {
+    unsigned long bucket[BUCKET_COUNT + 1];
+    unsigned long sum_us;
+};
+
+// unsigned long is lock-free on every supported target, so the counters
+// can be bumped from signal handlers and threads without locking
+static unsigned long counters[METRICS_COUNTERS];
+static struct histogram histograms[METRICS_HISTOGRAMS];
+static unsigned long phases_us[METRICS_PHASES];
+
+/**
+ * @brief Increments a counter
+ * 
+ * @param counter METRICS_* counter id
+ */
+void metrics_inc(unsigned int counter) {
+    if (counter < METRICS_COUNTERS)
+        __atomic_add_fetch(&counters[counter], 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Records a duration in a histogram
+ * 
+ * @param histogram METRICS_SVC_* histogram id
+ * @param seconds observed duration
+ */
+void metrics_observe(unsigned int histogram, double seconds) {
+    if (histogram >= METRICS_HISTOGRAMS)
+        return;
+
+    struct histogram* h = &histograms[histogram];
+    uint8_t i = 0;
+    while (i < BUCKET_COUNT && seconds > buckets[i])
+        i++;
+
+    __atomic_add_fetch(&h->bucket[i], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->sum_us, (unsigned long)(seconds * 1e6), __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Stores time spent in a boot phase
+ * 
+ * @param phase METRICS_PHASE_* id
+ * @param seconds duration of the phase
+ */
+void metrics_setPhase(unsigned int phase, double seconds) {
+    if (phase < METRICS_PHASES)
+        __atomic_store_n(&phases_us[phase], (unsigned long)(seconds * 1e6), __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Formats all metrics in Prometheus text format
+ * 
+ * @param buf output buffer
+ * @param size size of the buffer
+ * @return size_t length of the text
+ */
+static size_t formatMetrics(char* buf, size_t size) {
+    size_t len = 0;
+
+#define APPEND(...)                                                  \
+    do {                                                             \
+        if (len < size)                                              \
+            len += snprintf(buf + len, size - len, __VA_ARGS__);     \
+    } while (0)
+
+    for (uint8_t i = 0; i < METRICS_COUNTERS; i++) {
+        APPEND("# HELP %s %s\n# TYPE %s counter\n", counter_names[i][0], counter_names[i][1], counter_names[i][0]);
+        APPEND("%s %lu\n", counter_names[i][0], __atomic_load_n(&counters[i], __ATOMIC_RELAXED));
+    }
+
+    for (uint8_t i = 0; i < METRICS_HISTOGRAMS; i++) {
+        const char* name = histogram_names[i][0];
+        struct histogram* h = &histograms[i];
+        unsigned long cumulative = 0;
+
+        APPEND("# HELP %s %s\n# TYPE %s histogram\n", name, histogram_names[i][1], name);
+        for (uint8_t b = 0; b < BUCKET_COUNT; b++) {
+            cumulative += __atomic_load_n(&h->bucket[b], __ATOMIC_RELAXED);
+            APPEND("%s_bucket{le=\"%g\"} %lu\n", name, buckets[b], cumulative);
+        }
+        cumulative += __atomic_load_n(&h->bucket[BUCKET_COUNT], __ATOMIC_RELAXED);
+        APPEND("%s_bucket{le=\"+Inf\"} %lu\n", name, cumulative);
+        APPEND("%s_sum %.6f\n", name, __atomic_load_n(&h->sum_us, __ATOMIC_RELAXED) / 1e6);
+        APPEND("%s_count %lu\n", name, cumulative);
+    }
+
+    APPEND("# HELP quickinit_boot_phase_seconds Time spent in each boot phase\n# TYPE quickinit_boot_phase_seconds gauge\n");
+    for (uint8_t i = 0; i < METRICS_PHASES; i++) {
+        APPEND("quickinit_boot_phase_seconds{phase=\"%s\"} %.6f\n", phase_names[i], __atomic_load_n(&phases_us[i], __ATOMIC_RELAXED) / 1e6);
+    }
+#undef APPEND
+
+    return len < size ? len : size - 1;
+}
+
+/**
+ * @brief Metrics server thread, answers every connection with current metrics
+ * 
+ * @param arg listening socket
+ */
+static void* metricsThread(void* arg) {
+    int sock = (int)(intptr_t)arg;
+    char* buf = (char*)malloc(METRICS_BUFSIZE * sizeof(char));
+
+    while (buf) {
+        int client = accept4(sock, NULL, NULL, SOCK_CLOEXEC);  // spawned services mustn't inherit it
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN)
+                continue;
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                sleep(METRICS_ACCEPT_BACKOFF);  // retrying at once would spin until a descriptor is freed
+                continue;
+            }
+            console_error("metrics socket failed: %s, metrics aren't served anymore\r\n", strerror(errno));
+            break;
+        }
+
+        size_t len = formatMetrics(buf, METRICS_BUFSIZE);
+        size_t off = 0;
+        while (off < len) {
+            ssize_t n = write(client, buf + off, len - off);
+            if (n <= 0)
+                break;
+            off += n;
+        }
+        close(client);
+    }
+    free(buf);
+    close(sock);
+    return NULL;
+}
+
+/**
+ * @brief Creates metrics socket and starts the server thread
+ * 
+ */
+void metrics_init() {
+    util_dirCreate(RUN_DIR, 0755);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        console_error("failed creating metrics socket\r\n");
+        return;
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, METRICS_SOCKET, sizeof(addr.sun_path) - 1);
+    unlink(METRICS_SOCKET);
+
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(sock, 4) < 0) {
+        console_error("failed binding %s\r\n", METRICS_SOCKET);
+        close(sock);
+        return;
+    }
+
+    pthread_t metrics_thread;
+    if (pthread_create(&metrics_thread, NULL, metricsThread, (void*)(intptr_t)sock)) {
+        console_error("error creating thread\r\n");
+        close(sock);
+    }
+}
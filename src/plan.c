@@ -0,0 +1,131 @@
+/**
+ * @file plan.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "process.h"
+
+/*! \cond PRIVATE */
+#define ENV_PATH "PATH=/usr/bin:/bin:/usr/sbin:/sbin"
+/*! \endcond */
+
+static char *ENV[] = {
+    "TERM=vt100",
+    "HOME=/",
+    ENV_PATH,
+    "SHELL=/bin/sh",
+    "USER=root",
+    NULL};
+
+/**
+ * @brief Finds executable in PATH of the environment, or resolves symlinks if the path is given
+ * 
+ * @param a arena for the result
+ * @param name argv[0]
+ * @return const char* resolved path, name itself if it can't be resolved (exec reports the error)
+ */
+static const char *resolvePath(struct arena *a, const char *name) {
+    char buf[PATH_MAX];
+
+    if (strchr(name, '/') != NULL) {
+        if (realpath(name, buf) == NULL)
+            return name;
+        const char *path = arena_strdup(a, buf);
+        return path ? path : name;
+    }
+
+    const char *dirs = ENV_PATH + strlen("PATH=");
+    while (*dirs != '\0') {
+        size_t len = strcspn(dirs, ":");
+        if ((size_t)snprintf(buf, sizeof(buf), "%.*s/%s", (int)len, dirs, name) < sizeof(buf) && access(buf, X_OK) == 0) {
+            const char *path = arena_strdup(a, buf);
+            return path ? path : name;
+        }
+        dirs += len;
+        if (*dirs == ':')
+            dirs++;
+    }
+    return name;
+}
+
+/**
+ * @brief Builds plan for spawning the command, so nothing is parsed or allocated at spawn
+ * 
+ * @param a arena in which the plan lives
+ * @param plan output
+ * @param cmd program with parameters separated by spaces
+ * @param tty path to the tty device, NULL if stdio goes to /dev/null
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t process_buildPlan(struct arena *a, struct process_plan *plan, const char *cmd, const char *tty) {
+    char *buf = arena_strdup(a, cmd);
+    if (!buf)
+        return EXIT_FAILURE;
+
+    size_t argc = 0;
+    for (char *p = buf; *p != '\0';) {  // count arguments
+        p += strspn(p, " \n");
+        if (*p == '\0')
+            break;
+        argc++;
+        p += strcspn(p, " \n");
+    }
+    if (argc == 0)
+        return EXIT_FAILURE;
+
+    uint8_t envc = sizeof(ENV) / sizeof(ENV[0]) - 1;
+    plan->argv = (char **)arena_alloc(a, (argc + 1) * sizeof(char *));
+    plan->envp = (char **)arena_alloc(a, (envc + 1) * sizeof(char *));
+    if (!plan->argv || !plan->envp)
+        return EXIT_FAILURE;
+
+    char *saveptr;
+    size_t i = 0;
+    for (char *tok = strtok_r(buf, " \n", &saveptr); tok != NULL; tok = strtok_r(NULL, " \n", &saveptr))
+        plan->argv[i++] = tok;
+    plan->argv[i] = NULL;
+
+    memcpy(plan->envp, ENV, (envc + 1) * sizeof(char *));
+    plan->envc = envc;
+    plan->stdio = tty ? tty : "/dev/null";
+    plan->is_tty = tty != NULL;
+    plan->affinity = NULL;
+    plan->cgroup = NULL;
+    plan->path = resolvePath(a, plan->argv[0]);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Adds variable to the environment of the plan
+ * 
+ * @param a arena in which the plan lives
+ * @param plan plan built by process_buildPlan
+ * @param entry NAME=value, copied to the arena
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t process_addEnv(struct arena *a, struct process_plan *plan, const char *entry) {
+    if (plan->envc == UINT8_MAX)
+        return EXIT_FAILURE;
+    char **envp = (char **)arena_alloc(a, (plan->envc + 2) * sizeof(char *));
+    char *copy = arena_strdup(a, entry);
+    if (!envp || !copy)
+        return EXIT_FAILURE;
+
+    memcpy(envp, plan->envp, plan->envc * sizeof(char *));
+    envp[plan->envc++] = copy;
+    envp[plan->envc] = NULL;
+    plan->envp = envp;
+    return EXIT_SUCCESS;
+}
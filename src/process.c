@@ -9,6 +9,8 @@
  */
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,20 +19,20 @@
 #include <sys/prctl.h>
 #include <sys/reboot.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "activation.h"
+#include "cgroup.h"
 #include "console.h"
+#include "metrics.h"
+#include "process.h"
 #include "signals.h"
-#include "tty.h"
+#include "trace.h"
+#include "utilities.h"
 
-static char *ENV[] = {
-    "TERM=vt100",
-    "HOME=/",
-    "PATH=/usr/bin:/bin:/usr/sbin:/sbin",
-    "SHELL=/bin/sh",
-    "USER=root",
-    NULL};
+static uint8_t inherit_stdio = 0;  // 1 in container mode, children write to init's stdout
 
 /**
  * @brief Kills everything (use before shutdown/reboot)
@@ -41,41 +43,274 @@ void process_killEverything() {
 
     console_info("Sending SIGTERM to all processes\r\n");
     kill(-1, SIGTERM);
-    sync();
     sleep(1);
 
     console_info("Sending SIGKILL to all processes\r\n");
     kill(-1, SIGKILL);
-    sync();
-    sleep(1);
+    sleep(1);  // filesystems are synced by shutdown when everything is dead
 }
 
 /**
- * @brief Spawns a children which will keep the init alive
+ * @brief Children which don't run on a tty keep stdout and stderr of init, used in container mode
+ * 
+ */
+void process_inheritStdio() {
+    inherit_stdio = 1;
+}
+
+/**
+ * @brief Entry of the PID to owner table
  * 
- * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
  */
-uint8_t process_spawnChildren() {
-    int i;
-    pid_t pid;
+struct process_owner {
+    pid_t pid;  // 0 if the slot is free
+    process_exitCallback cb;
+    void *owner;
+};
 
-    signals_blockAll();
-    pid = fork();
+static struct process_owner *owners = NULL;
+static size_t owners_size = 0;  // always a power of two
+static size_t owners_used = 0;
 
-    if (pid < 0) {
+/**
+ * @brief Hashes PID into a slot of the owner table
+ * 
+ * @param pid pid
+ * @return size_t slot index
+ */
+static inline size_t ownerSlot(pid_t pid) {
+    return ((uint32_t)pid * 2654435761u) & (owners_size - 1);  // Knuth multiplicative hash
+}
+
+/**
+ * @brief Inserts an entry without growing the table
+ * 
+ * @param entry entry to insert
+ */
+static void ownerInsert(const struct process_owner *entry) {
+    size_t i = ownerSlot(entry->pid);
+    while (owners[i].pid != 0 && owners[i].pid != entry->pid)
+        i = (i + 1) & (owners_size - 1);
+    if (owners[i].pid == 0)
+        owners_used++;
+    owners[i] = *entry;
+}
+
+/**
+ * @brief Doubles the size of the owner table
+ * 
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t ownersGrow() {
+    size_t old_size = owners_size;
+    struct process_owner *old = owners;
+    size_t new_size = old_size ? old_size * 2 : PROCESS_TABLE_MINSIZE;
+
+    struct process_owner *table = (struct process_owner *)calloc(new_size, sizeof(struct process_owner));
+    if (!table)
         return EXIT_FAILURE;
-    } else if (pid > 0) {
-        for (;;) {
-            wait(&i);
+
+    owners = table;
+    owners_size = new_size;
+    owners_used = 0;
+    for (size_t i = 0; i < old_size; i++) {
+        if (old[i].pid != 0)
+            ownerInsert(&old[i]);
+    }
+    free(old);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Register owner which is notified when the child exits
+ * 
+ * @param pid pid of the child
+ * @param cb callback
+ * @param owner pointer passed to the callback eg. tty or service
+ */
+void process_watch(pid_t pid, process_exitCallback cb, void *owner) {
+    if (pid <= 0)
+        return;
+    if ((owners_used + 1) * 2 > owners_size && ownersGrow() != EXIT_SUCCESS) {  // keep load under 50%
+        console_error("no memory for watching PID=%d\r\n", pid);
+        return;
+    }
+    struct process_owner entry = {.pid = pid, .cb = cb, .owner = owner};
+    ownerInsert(&entry);
+}
+
+/**
+ * @brief Removes the owner of the child and returns it
+ * 
+ * @param pid pid of the child
+ * @param out removed entry
+ * @return uint8_t 1 if the child had an owner
+ */
+static uint8_t ownerTake(pid_t pid, struct process_owner *out) {
+    if (owners_size == 0)
+        return 0;
+
+    size_t i = ownerSlot(pid);
+    while (owners[i].pid != pid) {
+        if (owners[i].pid == 0)
+            return 0;
+        i = (i + 1) & (owners_size - 1);
+    }
+    if (out)
+        *out = owners[i];
+
+    // backward shift deletion, keeps probe sequences intact without tombstones
+    size_t hole = i;
+    for (size_t j = (i + 1) & (owners_size - 1); owners[j].pid != 0; j = (j + 1) & (owners_size - 1)) {
+        size_t home = ownerSlot(owners[j].pid);
+        if (((j - home) & (owners_size - 1)) >= ((j - hole) & (owners_size - 1))) {
+            owners[hole] = owners[j];
+            hole = j;
+        }
+    }
+    owners[hole].pid = 0;
+    owners_used--;
+    return 1;
+}
+
+/**
+ * @brief Forget the owner of the child, its exit will be reaped silently
+ * 
+ * @param pid pid of the child
+ */
+void process_unwatch(pid_t pid) {
+    ownerTake(pid, NULL);
+}
+
+/**
+ * @brief Converts siginfo from waitid to exit information and accounts it in metrics
+ * 
+ * @param info siginfo filled by waitid
+ * @param ex output
+ */
+static void fillExit(const siginfo_t *info, struct process_exit *ex) {
+    ex->pid = info->si_pid;
+    if (info->si_code == CLD_EXITED) {
+        ex->code = info->si_status;
+        ex->signal = 0;
+    } else {
+        ex->code = -1;
+        ex->signal = info->si_status;
+    }
+
+    metrics_inc(METRICS_REAPS);
+    if (ex->code == PROCESS_EXEC_FAILED)
+        metrics_inc(METRICS_EXEC_FAILURES);
+}
+
+/**
+ * @brief Reaps all exited children and notifies their owners, orphans are reaped silently
+ * 
+ */
+void process_reap() {
+    struct process_exit batch[PROCESS_REAP_BATCH];
+    size_t count;
+
+    do {
+        count = 0;
+        while (count < PROCESS_REAP_BATCH) {
+            siginfo_t info = {0};
+            struct process_exit *ex = &batch[count];
+            // raw syscall, glibc doesn't expose the rusage argument of waitid
+            if (syscall(SYS_waitid, P_ALL, 0, &info, WEXITED | WNOHANG, &ex->usage) < 0 || info.si_pid == 0)
+                break;
+            fillExit(&info, ex);
+            TRACE(reap, ex->pid, ex->code, ex->signal);
+            count++;
         }
+
+        for (size_t i = 0; i < count; i++) {
+            struct process_owner owner;
+            if (ownerTake(batch[i].pid, &owner))
+                owner.cb(owner.owner, &batch[i]);
+        }
+    } while (count == PROCESS_REAP_BATCH);
+}
+
+/**
+ * @brief Waits until the child exits or the timeout passes, doesn't reap it
+ * 
+ * @param pid pid of the child
+ * @param timeout timeout [seconds]
+ * @return uint8_t 1 if the child has exited
+ */
+static uint8_t waitExited(pid_t pid, double timeout) {
+    double deadline = util_monotonicTime() + timeout;
+    int pidfd = -1;
+#ifdef SYS_pidfd_open
+    pidfd = syscall(SYS_pidfd_open, pid, 0);
+#endif
+    for (;;) {
+        double left = deadline - util_monotonicTime();
+        if (pidfd >= 0) {  // pidfd becomes readable when the child exits
+            struct pollfd pfd = {.fd = pidfd, .events = POLLIN};
+            int ret = poll(&pfd, 1, left > 0 ? (int)(left * 1000) + 1 : 0);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            close(pidfd);
+            return ret != 0;  // errors are left to waitid
+        }
+
+        siginfo_t info = {0};  // kernel without pidfd, poll the child
+        if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) < 0 || info.si_pid != 0)
+            return 1;
+        if (left <= 0)
+            return 0;
+        usleep(PROCESS_WAIT_POLL_US);
     }
+}
+
+/**
+ * @brief Blocks until the child exits, the owner is not notified
+ * 
+ * @param pid pid of the child
+ * @param ex exit information output, can be NULL
+ * @param timeout timeout [seconds], 0 waits forever
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE, also if the timeout passed and the child is still running
+ */
+uint8_t process_waitFor(pid_t pid, struct process_exit *ex, double timeout) {
+    struct process_exit tmp;
+    if (!ex)
+        ex = &tmp;
+    if (timeout > 0 && !waitExited(pid, timeout))
+        return EXIT_FAILURE;
 
-    signals_unblockAll();
-    setsid();
-    setpgid(0, 0);
+    siginfo_t info = {0};
+    while (syscall(SYS_waitid, P_PID, pid, &info, WEXITED, &ex->usage) < 0) {
+        if (errno != EINTR)
+            return EXIT_FAILURE;
+    }
+    ownerTake(pid, NULL);
+    fillExit(&info, ex);
     return EXIT_SUCCESS;
 }
 
+/**
+ * @brief Adds resources used by the exited child to the totals
+ * 
+ * @param total totals eg. of a service
+ * @param ex exit information with rusage of the child
+ * @param wall time between spawn and exit [seconds]
+ */
+void process_addUsage(struct process_usage *total, const struct process_exit *ex, double wall) {
+    const struct rusage *ru = &ex->usage;
+
+    total->user += ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6;
+    total->sys += ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+    total->wall += wall;
+    if (ru->ru_maxrss > total->maxrss)
+        total->maxrss = ru->ru_maxrss;
+    total->majflt += ru->ru_majflt;
+    total->nvcsw += ru->ru_nvcsw;
+    total->nivcsw += ru->ru_nivcsw;
+    total->runs++;
+}
+
 /**
  * @brief Redirect streams to device
  * 
@@ -134,47 +369,75 @@ static uint8_t detachTty(const char *devbuf, const uint8_t detach) {
 }
 
 /**
- * @brief Execute program or tty
+ * @brief Moves listening sockets to consecutive descriptors from ACTIVATION_FDS_START
+ * and adds LISTEN_FDS and LISTEN_PID to the environment, runs in the child
  * 
- * @param prog char* program with parameters
- * @param istty 1 if it's tty, 0 if it's not  
- * @param tty number of tty
- * @return pid_t pid
+ * @param plan plan of the program
+ * @param fds listening sockets
+ * @param nfds number of sockets
+ * @param env output environment, must have room for envp of the plan and two more entries
+ * @param listen_fds buffer for LISTEN_FDS entry
+ * @param listen_pid buffer for LISTEN_PID entry
  */
-static pid_t executeProg(char *prog, const uint8_t istty, const uint8_t tty) {
-    int MAXARGS = 255;
-    int i = 0;
-    int status;
-    char *argv[MAXARGS];
-
-    char *buf = (char *)malloc((strlen(prog) + 1) * sizeof(char));
-    strcpy(buf, prog);
-    argv[i = 0] = strtok(buf, " \n");
-    while (i < MAXARGS && argv[i] != NULL)
-        argv[++i] = strtok(NULL, " \n");
+static void passFds(const struct process_plan *plan, const int *fds, const uint8_t nfds, char **env, char *listen_fds, char *listen_pid) {
+    int tmp[nfds];
+    for (uint8_t i = 0; i < nfds; i++)  // first move out of the target range, so no socket is overwritten
+        tmp[i] = fcntl(fds[i], F_DUPFD, ACTIVATION_FDS_START + nfds);
+    for (uint8_t i = 0; i < nfds; i++) {
+        dup2(tmp[i], ACTIVATION_FDS_START + i);  // dup2 clears close-on-exec
+        close(tmp[i]);
+    }
 
-    argv[++i] = NULL;  // NUL on end
-    free(buf);
+    uint8_t n = 0;
+    for (; n < plan->envc; n++)
+        env[n] = plan->envp[n];
+    sprintf(listen_fds, "LISTEN_FDS=%d", nfds);
+    sprintf(listen_pid, "LISTEN_PID=%d", getpid());
+    env[n++] = listen_fds;
+    env[n++] = listen_pid;
+    env[n] = NULL;
+}
 
-    if (istty == 1) {
-        detachTty(tty_data[tty].dev, 1);  // detach from controlling terminal
+/**
+ * @brief Spawns program from its plan, doesn't allocate memory in init
+ * 
+ * @param plan plan of the program
+ * @param fds listening sockets passed to the program, can be NULL
+ * @param nfds number of sockets
+ * @param in descriptor which becomes stdin, -1 to use stdio of the plan
+ * @param out descriptor which becomes stdout, -1 to use stdio of the plan
+ * @return pid_t pid
+ */
+static pid_t executePlan(const struct process_plan *plan, const int *fds, const uint8_t nfds, int in, int out) {
+    if (plan->is_tty) {
+        detachTty(plan->stdio, 1);  // detach from controlling terminal
     }
 
     pid_t pid = fork();
 
-    if (pid < 0) {
-        console_error("fork failed\r\n");
-        exit(EXIT_FAILURE);
+    if (pid < 0) {  // exiting would panic the kernel, callers treat it as failed start
+        console_error("fork of %s failed: %s\r\n", plan->path, strerror(errno));
+        return -1;
+    }
+
+    if (pid > 0) {
+        metrics_inc(METRICS_SPAWNS);
+        TRACE(spawn, pid, plan->path);
     }
 
     if (pid == 0) {  // is a child
 
-        if (istty == 1) {
-            vhangup();                                // ensure that terminal is clean
-            redirectStdio(tty_data[tty].dev, "eio");  // redirect stdio stderr stdout to tty
-        } else {
-            redirectStdio("/dev/null", "eio");
+        if (plan->is_tty) {
+            vhangup();  // ensure that terminal is clean
         }
+        if (inherit_stdio && !plan->is_tty)
+            redirectStdio(plan->stdio, "i");  // output goes where init's output goes
+        else
+            redirectStdio(plan->stdio, "eio");  // redirect stdio stderr stdout to tty or /dev/null
+        if (in >= 0)
+            dup2(in, STDIN_FILENO);  // dup2 clears close-on-exec
+        if (out >= 0)
+            dup2(out, STDOUT_FILENO);
 
         signals_unblockAll();
         signals_restoreDefault();
@@ -182,47 +445,60 @@ static pid_t executeProg(char *prog, const uint8_t istty, const uint8_t tty) {
         setsid();
         setpgid(0, getpid());
 
-        if (istty == 1) {
-            detachTty(tty_data[tty].dev, 0);  // attach to controlling terminal
-            if (tty_data[tty].action == TTY_ACTION_ASKFIRST) {
-                char *pname_buf = "tty_askfirst";
-                prctl(PR_SET_NAME, pname_buf);
-
-                printf("Please press Enter to activate this console. \r\n");
-                char c;
-                while (read(STDIN_FILENO, &c, 1) == 1 && c != '\n')
-                    ;
-                console_clearTty(tty_data[tty].dev);
-            }
+        if (plan->affinity)
+            topology_apply(plan->affinity);
+        if (plan->cgroup)
+            cgroup_join(plan->cgroup);
+
+        if (plan->is_tty) {
+            detachTty(plan->stdio, 0);  // attach to controlling terminal
         }
-        if (execve(argv[0], argv, ENV) < 0) {
-            console_error("exec failed\r\n");
-            exit(1);
-        } else {
-            while (wait(&status) != pid)
-                ;
+        char **envp = plan->envp;
+        char *activation_env[plan->envc + 3];
+        char listen_fds[32], listen_pid[32];
+        if (nfds > 0) {
+            passFds(plan, fds, nfds, activation_env, listen_fds, listen_pid);
+            envp = activation_env;
         }
+
+        TRACE_CHILD(exec, getpid(), plan->path);
+        execve(plan->path, plan->argv, envp);
+        console_error("exec of %s failed: %s\r\n", plan->path, strerror(errno));
+        exit(PROCESS_EXEC_FAILED);
     }
     return pid;
 }
 
 /**
- * @brief Execute a program
+ * @brief Spawn a program
+ * 
+ * @param plan plan built by process_buildPlan
+ * @return pid_t pid of a program, -1 if fork failed
+ */
+pid_t process_spawn(const struct process_plan *plan) {
+    return executePlan(plan, NULL, 0, -1, -1);
+}
+
+/**
+ * @brief Spawn a program with listening sockets, as in socket activation
  * 
- * @param prog path with parameters
- * @return pid_t pid of a program
+ * @param plan plan built by process_buildPlan
+ * @param fds listening sockets
+ * @param nfds number of sockets
+ * @return pid_t pid of a program, -1 if fork failed
  */
-pid_t process_execute(char *prog) {
-    return executeProg(prog, 0, 0);  // isn't tty, 0
+pid_t process_spawnWithFds(const struct process_plan *plan, const int *fds, uint8_t nfds) {
+    return executePlan(plan, fds, nfds, -1, -1);
 }
 
 /**
- * @brief Execute a program on tty
+ * @brief Spawn a program with stdin and stdout connected to pipes, stderr goes to stdio of the plan
  * 
- * @param prog path with parameters
- * @param tty tty number 
- * @return pid_t pid of a program
+ * @param plan plan built by process_buildPlan
+ * @param in read end of a pipe which becomes stdin
+ * @param out write end of a pipe which becomes stdout
+ * @return pid_t pid of a program, -1 if fork failed
  */
-pid_t process_executeTty(char *prog, int tty) {
-    return executeProg(prog, 1, tty);  // istty, tty number
+pid_t process_spawnPiped(const struct process_plan *plan, int in, int out) {
+    return executePlan(plan, NULL, 0, in, out);
 }
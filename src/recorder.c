@@ -0,0 +1,212 @@
+/**
+ * @file recorder.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "recorder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "console.h"
+#include "utilities.h"
+
+/*! \cond PRIVATE */
+#define DUMP_LINELEN 256
+/*! \endcond */
+
+/**
+ * @brief Recorder used before RECORDER_FILE is mapped, its events are copied there
+ * 
+ */
+static struct {
+    struct recorder_header header;
+    struct recorder_entry entries[RECORDER_ENTRIES];
+} early = {.header = {.magic = RECORDER_MAGIC, .version = RECORDER_VERSION, .entry_size = sizeof(struct recorder_entry), .capacity = RECORDER_ENTRIES}};
+
+static struct recorder_header *header = &early.header;
+static struct recorder_entry *entries = early.entries;
+static int kmsg_fd = -1;  // crash dump goes to stderr if the kernel log isn't writable
+static char altstack[RECORDER_ALTSTACK];
+
+/**
+ * @brief Stores the event in the next entry of the ring
+ * Entry is claimed by moving its seq from even to odd, if that fails the event is dropped rather than
+ * interleaved with another writer.
+ * @param event event with its time and arguments, seq and index are ignored
+ */
+static void store(const struct recorder_entry *event) {
+    uint64_t index = __atomic_fetch_add(&header->head, 1, __ATOMIC_ACQ_REL);
+    struct recorder_entry *e = &entries[index & (RECORDER_ENTRIES - 1)];
+
+    uint32_t seq = __atomic_load_n(&e->seq, __ATOMIC_RELAXED);
+    if ((seq & 1) || !__atomic_compare_exchange_n(&e->seq, &seq, seq + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    e->event = event->event;
+    e->index = index;
+    e->time = event->time;
+    memcpy(e->values, event->values, sizeof(e->values));
+    memcpy(e->text, event->text, sizeof(e->text));
+    __atomic_store_n(&e->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Records the event, use TRACE instead
+ * Only copies the arguments, they're formatted when the event is read. Never called in forked children.
+ * @param event RECORDER_EVENT_*
+ * @param args arguments
+ * @param count number of arguments, at most RECORDER_VALUES are kept
+ */
+void recorder_add(uint16_t event, const struct recorder_arg *args, uint8_t count) {
+    struct recorder_entry e = {.event = event};
+    size_t text = 0;
+    for (uint8_t i = 0; i < count && i < RECORDER_VALUES; i++) {
+        if (args[i].text == NULL) {
+            e.values[i] = args[i].value;
+        } else if (text < RECORDER_TEXTLEN) {  // the rest of strings is empty when it's full
+            size_t len = strnlen(args[i].text, RECORDER_TEXTLEN - text - 1);
+            memcpy(&e.text[text], args[i].text, len);
+            text += len + 1;  // e is zeroed, so it's terminated
+        }
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    e.time = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    store(&e);
+}
+
+/**
+ * @brief Appends decimal number to the buffer, snprintf isn't async-signal-safe
+ * 
+ * @param buf buffer
+ * @param len current length, updated
+ * @param value number
+ * @param width minimal width
+ * @param pad character which pads it to the width
+ */
+static void appendNumber(char *buf, size_t *len, uint64_t value, uint8_t width, char pad) {
+    char digits[20];
+    uint8_t n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    while (n < width)
+        digits[n++] = pad;
+    while (n > 0)
+        buf[(*len)++] = digits[--n];
+}
+
+/**
+ * @brief Appends string to the buffer
+ * 
+ * @param buf buffer of DUMP_LINELEN
+ * @param len current length, updated
+ * @param text string
+ */
+static void appendText(char *buf, size_t *len, const char *text) {
+    for (size_t i = 0; text[i] != '\0' && *len < DUMP_LINELEN - 1; i++)
+        buf[(*len)++] = text[i];
+}
+
+/**
+ * @brief Dumps recorded events when init crashes, runs on the alternate stack
+ * Init exits afterwards, what makes the kernel panic with the dump in its log.
+ * @param signal signal which was received
+ */
+static void crashed(int signal) {
+    int fd = kmsg_fd >= 0 ? kmsg_fd : STDERR_FILENO;
+    char line[DUMP_LINELEN];
+    size_t len = 0;
+    appendText(line, &len, "<2>quickInit: crashed with signal ");
+    appendNumber(line, &len, signal, 1, ' ');
+    appendText(line, &len, ", last events:\n");
+    write(fd, line, len);
+
+    uint64_t head = header->head;
+    uint64_t first = head > RECORDER_ENTRIES ? head - RECORDER_ENTRIES : 0;
+    for (uint64_t i = first; i < head; i++) {
+        const struct recorder_entry *e = &entries[i & (RECORDER_ENTRIES - 1)];
+        if (e->index != i)
+            continue;
+        len = 0;
+        appendText(line, &len, "<2>quickInit: [");
+        appendNumber(line, &len, e->time / 1000000000, 5, ' ');
+        line[len++] = '.';
+        appendNumber(line, &len, e->time % 1000000000 / 1000, 6, '0');
+        appendText(line, &len, "] ");
+        recorder_format(e, line, &len, DUMP_LINELEN - 1);
+        line[len++] = '\n';
+        write(fd, line, len);  // one record of the kernel log per event
+    }
+    _exit(128 + signal);
+}
+
+/**
+ * @brief Installs the crash handler, events are recorded from the start
+ * 
+ */
+void recorder_init() {
+    stack_t stack = {.ss_sp = altstack, .ss_size = sizeof(altstack)};
+    if (sigaltstack(&stack, NULL) < 0)
+        console_error("failed setting alternate stack: %s\r\n", strerror(errno));
+
+    struct sigaction sa = {.sa_handler = crashed, .sa_flags = SA_ONSTACK | SA_RESETHAND};
+    sigfillset(&sa.sa_mask);
+    int signals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+    for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++)
+        sigaction(signals[i], &sa, NULL);
+}
+
+/**
+ * @brief Moves the recorder to RECORDER_FILE, so telinit can read it
+ * Events of init which executed this one, eg. from initramfs, are kept.
+ */
+void recorder_publish() {
+    if (header != &early.header)  // already published
+        return;
+    kmsg_fd = open(RECORDER_KMSG, O_WRONLY | O_NOCTTY | O_CLOEXEC);
+
+    util_dirCreate(RUN_DIR, 0755);
+    int fd = open(RECORDER_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(early)) < 0) {
+        console_error("failed creating %s: %s\r\n", RECORDER_FILE, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    void *map = mmap(NULL, sizeof(early), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        console_error("failed mapping %s: %s\r\n", RECORDER_FILE, strerror(errno));
+        return;
+    }
+
+    struct recorder_header *published = map;
+    if (published->magic != RECORDER_MAGIC || published->version != RECORDER_VERSION ||
+        published->entry_size != sizeof(struct recorder_entry) || published->capacity != RECORDER_ENTRIES) {
+        memset(map, 0, sizeof(early));
+        *published = early.header;
+        published->head = 0;
+    }
+
+    uint64_t head = early.header.head;
+    uint64_t first = head > RECORDER_ENTRIES ? head - RECORDER_ENTRIES : 0;
+    header = published;
+    entries = (struct recorder_entry *)(published + 1);
+    for (uint64_t i = first; i < head; i++)
+        store(&early.entries[i & (RECORDER_ENTRIES - 1)]);
+}
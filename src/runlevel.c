@@ -0,0 +1,68 @@
+/**
+ * @file runlevel.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "runlevel.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "console.h"
+#include "svc.h"
+#include "tty.h"
+#include "utilities.h"
+
+static uint8_t current = DEFAULT_RUNLEVEL;
+
+/**
+ * @brief Sets initial runlevel, quickinit.runlevel= on kernel cmdline overrides the default
+ * 
+ */
+void runlevel_init() {
+    char buf[4];
+    if (util_cmdlineGet("quickinit.runlevel", buf, sizeof(buf)) == EXIT_SUCCESS) {
+        if (buf[0] >= '0' && buf[0] <= '0' + RUNLEVEL_MAX && buf[1] == '\0')
+            current = buf[0] - '0';
+        else
+            console_error("invalid runlevel %s on kernel cmdline\r\n", buf);
+    }
+    console_info("entering runlevel %d\r\n", current);
+}
+
+/**
+ * @brief Returns current runlevel
+ * 
+ * @return uint8_t runlevel
+ */
+uint8_t runlevel_current() {
+    return current;
+}
+
+/**
+ * @brief Switches to another runlevel, only what differs is stopped or started
+ * 
+ * @param level new runlevel
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t runlevel_switch(int level) {
+    if (level < 0 || level > RUNLEVEL_MAX) {
+        console_error("invalid runlevel %d\r\n", level);
+        return EXIT_FAILURE;
+    }
+    if (level == current)
+        return EXIT_SUCCESS;
+
+    uint8_t old = current;
+    current = level;
+    console_info("switching runlevel %d -> %d\r\n", old, level);
+
+    tty_switchRunlevel(old, level);
+    svc_switchRunlevel(old, level);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,36 @@
+/**
+ * @file runlevelparse.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "runlevel.h"
+
+/**
+ * @brief Parses list of runlevels eg. "2345", empty string means all runlevels
+ * 
+ * @param str string with digits
+ * @param mask output mask
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t runlevel_parse(const char* str, uint16_t* mask) {
+    if (*str == '\0') {
+        *mask = RUNLEVEL_ALL;
+        return EXIT_SUCCESS;
+    }
+
+    uint16_t result = 0;
+    for (; *str != '\0'; str++) {
+        if (*str < '0' || *str > '0' + RUNLEVEL_MAX)
+            return EXIT_FAILURE;
+        result |= 1 << (*str - '0');
+    }
+    *mask = result;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,378 @@
+/**
+ * @file shutdown.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#define _GNU_SOURCE
+#include "shutdown.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <sys/reboot.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "console.h"
+#include "process.h"
+#include "svc.h"
+#include "trace.h"
+#include "utilities.h"
+
+/**
+ * @brief Mounted filesystem from mountinfo
+ * 
+ */
+struct mount_entry {
+    int id;
+    int parent;
+    unsigned int major, minor;
+    uint16_t depth;  // number of ancestors, children are unmounted first
+    uint8_t done;    // 1 if it was unmounted or remounted read only
+    char* target;
+    char* fstype;
+};
+
+/**
+ * @brief Filesystems without backing storage, they don't need syncing nor unmounting
+ * 
+ */
+static const char* virtual_fs[] = {
+    "proc", "sysfs", "devtmpfs", "devpts", "tmpfs", "ramfs", "cgroup", "cgroup2",
+    "securityfs", "debugfs", "tracefs", "pstore", "bpf", "mqueue", "hugetlbfs",
+    "configfs", "fusectl", "efivarfs", "binfmt_misc", "autofs", "rpc_pipefs", "nsfs"};
+
+/**
+ * @brief Network filesystems, they are unmounted with MNT_FORCE so a dead server doesn't hang shutdown
+ * 
+ */
+static const char* network_fs[] = {"nfs", "nfs4", "cifs", "smb3", "9p", "ceph", "fuse.sshfs"};
+
+/**
+ * @brief State shared with sync threads
+ * 
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    unsigned int running;
+} syncing = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0};
+
+/**
+ * @brief Checks if the type is in the list
+ * 
+ * @param type filesystem type
+ * @param list list of types
+ * @param count number of types in the list
+ * @return uint8_t 1 if it is
+ */
+static uint8_t fsIn(const char* type, const char** list, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(type, list[i]) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Decodes octal escapes of mountinfo eg. \040 for space, in place
+ * 
+ * @param str string
+ */
+static void unescape(char* str) {
+    char* out = str;
+    for (; *str != '\0'; str++) {
+        if (str[0] == '\\' && str[1] >= '0' && str[1] <= '3' && str[2] >= '0' && str[2] <= '7' && str[3] >= '0' && str[3] <= '7') {
+            *out++ = (char)((str[1] - '0') << 6 | (str[2] - '0') << 3 | (str[3] - '0'));
+            str += 3;
+        } else {
+            *out++ = *str;
+        }
+    }
+    *out = '\0';
+}
+
+/**
+ * @brief Reads mount table
+ * 
+ * @param count output, number of entries
+ * @return struct mount_entry* entries in mount order, NULL if it can't be read
+ */
+static struct mount_entry* readMounts(size_t* count) {
+    FILE* fp = fopen(SHUTDOWN_MOUNTINFO, "re");
+    if (!fp) {
+        console_error("failed reading %s: %s\r\n", SHUTDOWN_MOUNTINFO, strerror(errno));
+        return NULL;
+    }
+
+    struct mount_entry* mounts = NULL;
+    size_t size = 0;
+    char* line = NULL;
+    size_t linesize = 0;
+    *count = 0;
+    while (getline(&line, &linesize, fp) > 0) {
+        struct mount_entry m = {0};
+        char target[PATH_MAX], fstype[64];
+        // id parent major:minor root target options [optional fields] - fstype source superoptions
+        if (sscanf(line, "%d %d %u:%u %*s %4095s", &m.id, &m.parent, &m.major, &m.minor, target) != 5)
+            continue;
+        char* sep = strstr(line, " - ");
+        if (!sep || sscanf(sep, " - %63s", fstype) != 1)
+            continue;
+
+        if (*count == size) {
+            size = size ? size * 2 : 64;
+            struct mount_entry* bigger = (struct mount_entry*)realloc(mounts, size * sizeof(struct mount_entry));
+            if (!bigger)
+                break;
+            mounts = bigger;
+        }
+        unescape(target);
+        m.target = strdup(target);
+        m.fstype = strdup(fstype);
+        if (!m.target || !m.fstype)
+            break;
+        mounts[(*count)++] = m;
+    }
+    free(line);
+    fclose(fp);
+
+    for (size_t i = 0; i < *count; i++) {  // depth by walking parents, bounded in case of a loop
+        int parent = mounts[i].parent;
+        while (mounts[i].depth < *count) {
+            size_t j = 0;
+            while (j < *count && mounts[j].id != parent)
+                j++;
+            if (j == *count || j == i)
+                break;
+            mounts[i].depth++;
+            parent = mounts[j].parent;
+        }
+    }
+    return mounts;
+}
+
+/**
+ * @brief Syncs one filesystem, runs in its own thread
+ * 
+ * @param arg target of the mount, freed by the thread
+ * @return void* NULL
+ */
+static void* syncThread(void* arg) {
+    char* target = (char*)arg;
+    int fd = open(target, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        if (syncfs(fd) < 0)
+            console_error("failed syncing %s: %s\r\n", target, strerror(errno));
+        close(fd);
+    }
+    free(target);
+
+    pthread_mutex_lock(&syncing.lock);
+    syncing.running--;
+    pthread_cond_signal(&syncing.done);
+    pthread_mutex_unlock(&syncing.lock);
+    return NULL;
+}
+
+/**
+ * @brief Syncs every backed filesystem in parallel, so a slow disk doesn't delay others
+ * Threads which don't finish within SHUTDOWN_SYNC_TIMEOUT are left behind.
+ * @param mounts mount table
+ * @param count number of entries
+ */
+static void syncAll(struct mount_entry* mounts, size_t count) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    for (size_t i = 0; i < count; i++) {
+        if (fsIn(mounts[i].fstype, virtual_fs, sizeof(virtual_fs) / sizeof(virtual_fs[0])))
+            continue;
+        uint8_t seen = 0;  // the same filesystem can be mounted many times, sync it once
+        for (size_t j = 0; j < i && !seen; j++)
+            seen = mounts[j].major == mounts[i].major && mounts[j].minor == mounts[i].minor;
+        if (seen)
+            continue;
+
+        char* target = strdup(mounts[i].target);
+        pthread_t thread;
+        if (!target)
+            continue;
+        pthread_mutex_lock(&syncing.lock);
+        syncing.running++;
+        pthread_mutex_unlock(&syncing.lock);
+        if (pthread_create(&thread, &attr, syncThread, target) != 0) {
+            pthread_mutex_lock(&syncing.lock);
+            syncing.running--;
+            pthread_mutex_unlock(&syncing.lock);
+            free(target);
+            sync();  // fallback for this filesystem
+        }
+    }
+    pthread_attr_destroy(&attr);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += SHUTDOWN_SYNC_TIMEOUT;
+
+    pthread_mutex_lock(&syncing.lock);
+    while (syncing.running > 0) {
+        if (pthread_cond_timedwait(&syncing.done, &syncing.lock, &deadline) == ETIMEDOUT) {
+            console_error("%u filesystems didn't finish syncing in %d s\r\n", syncing.running, SHUTDOWN_SYNC_TIMEOUT);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&syncing.lock);
+}
+
+/**
+ * @brief Unmounts the filesystem, remounts it read only if it's busy
+ * 
+ * @param m mount
+ * @return uint8_t 1 if it doesn't need another attempt
+ */
+static uint8_t unmountOne(struct mount_entry* m) {
+    int flags = fsIn(m->fstype, network_fs, sizeof(network_fs) / sizeof(network_fs[0])) ? MNT_FORCE : 0;
+    if (umount2(m->target, flags) == 0 || errno == EINVAL || errno == ENOENT)
+        return 1;  // EINVAL: not a mountpoint anymore, eg. parent was detached
+    if (errno != EBUSY)
+        return 0;
+
+    if (mount(NULL, m->target, NULL, MS_REMOUNT | MS_RDONLY, NULL) == 0) {
+        console_debug("%s is busy, remounted read only\r\n", m->target);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Unmounts filesystems children first, busy ones are remounted read only or detached
+ * / is only remounted read only.
+ */
+static void unmountAll() {
+    size_t count = 0;
+    struct mount_entry* mounts = readMounts(&count);
+    if (!mounts)
+        return;
+
+    console_info("syncing filesystems\r\n");
+    TRACE(shutdown, "sync", 0);
+    syncAll(mounts, count);
+
+    console_info("unmounting filesystems\r\n");
+    TRACE(shutdown, "unmount", 0);
+    double deadline = util_monotonicTime() + SHUTDOWN_UMOUNT_TIMEOUT;
+    uint16_t max_depth = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (mounts[i].depth > max_depth)
+            max_depth = mounts[i].depth;
+        if (fsIn(mounts[i].fstype, virtual_fs, sizeof(virtual_fs) / sizeof(virtual_fs[0])) || strcmp(mounts[i].target, "/") == 0)
+            mounts[i].done = 1;
+    }
+
+    size_t left = count;
+    for (uint8_t pass = 0; pass < SHUTDOWN_UMOUNT_PASSES && left > 0 && util_monotonicTime() < deadline; pass++) {
+        left = 0;
+        for (int depth = max_depth; depth >= 0; depth--) {
+            for (size_t i = count; i-- > 0;) {  // later mounts can shadow earlier ones on the same target
+                if (mounts[i].done || mounts[i].depth != depth)
+                    continue;
+                if (util_monotonicTime() >= deadline)
+                    break;
+                mounts[i].done = unmountOne(&mounts[i]);
+                left += !mounts[i].done;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (mounts[i].done)
+            continue;
+        console_error("failed unmounting %s, detaching it\r\n", mounts[i].target);
+        umount2(mounts[i].target, MNT_DETACH);
+    }
+
+    if (mount(NULL, "/", NULL, MS_REMOUNT | MS_RDONLY, NULL) < 0)
+        console_error("failed remounting / read only: %s\r\n", strerror(errno));
+    sync();  // flushes what remounting has written, everything else is synced already
+
+    for (size_t i = 0; i < count; i++) {
+        free(mounts[i].target);
+        free(mounts[i].fstype);
+    }
+    free(mounts);
+}
+
+/**
+ * @brief Reaps children until all have exited or the deadline passes
+ * 
+ * @param deadline monotonic time
+ * @return uint8_t 1 if all children have exited
+ */
+static uint8_t reapUntil(double deadline) {
+    for (;;) {
+        process_reap();  // owners are notified, so the main service records its status
+        siginfo_t info = {0};
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) < 0 && errno == ECHILD)
+            return 1;
+        if (util_monotonicTime() >= deadline)
+            return 0;
+        usleep(PROCESS_WAIT_POLL_US);
+    }
+}
+
+/**
+ * @brief Stops services and exits with status of the main service, used in container mode
+ * Everything that doesn't exit within CONTAINER_STOP_TIMEOUT is killed.
+ */
+void shutdown_container() {
+    static uint8_t stopping = 0;
+    if (stopping)  // main service has exited while services are being stopped
+        return;
+    stopping = 1;
+
+    double deadline = util_monotonicTime() + CONTAINER_STOP_TIMEOUT;
+    TRACE(shutdown, "services", 0);
+    svc_stopEnabledServices(deadline - CONTAINER_TERM_TIMEOUT);
+    TRACE(shutdown, "kill", 0);
+    kill(-1, SIGTERM);
+    if (!reapUntil(deadline)) {
+        console_error("processes didn't exit in %d s, killing them\r\n", CONTAINER_STOP_TIMEOUT);
+        kill(-1, SIGKILL);
+        reapUntil(util_monotonicTime() + 1);
+    }
+
+    int status = svc_mainStatus();
+    TRACE(shutdown, "exit", status);
+    console_info("exiting with status %d\r\n", status);
+    exit(status);
+}
+
+/**
+ * @brief Stops services, kills processes, syncs and unmounts filesystems and reboots
+ * 
+ * @param how RB_AUTOBOOT, RB_POWER_OFF or RB_HALT_SYSTEM
+ */
+void shutdown_system(int how) {
+    TRACE(shutdown, "services", 0);
+    svc_stopEnabledServices(0);
+    TRACE(shutdown, "kill", 0);
+    process_killEverything();
+    unmountAll();
+    TRACE(shutdown, "reboot", how);
+    reboot(how);
+}
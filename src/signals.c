@@ -7,17 +7,23 @@
  * 
  * 
  */
+#include <errno.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/reboot.h>
+#include <sys/signalfd.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
 #include "config.h"
 #include "console.h"
+#include "loop.h"
 #include "process.h"
-#include "svc.h"
+#include "runlevel.h"
+#include "shutdown.h"
+#include "signals.h"
 
 /**
  * @brief Blocks all signals
@@ -36,7 +42,7 @@ void signals_blockAll() {
 void signals_unblockAll() {
     sigset_t set;
     sigfillset(&set);
-    sigprocmask(SIG_BLOCK, &set, NULL);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
 }
 
 /**
@@ -49,34 +55,41 @@ void signals_restoreDefault() {
         sigaction(i, &sigact, NULL);
 }
 
+static uint8_t container_mode = 0;  // 1 if termination signals stop the container
+
 /**
  * @brief Internal init handler for reboot, shutdown etc. signals
  * 
  * @param signal 
+ * @param value value sent with sigqueue
  */
-static void sigHandler(int signal) {
+static void handleSignal(int signal, int value) {
+    if (signal == SIGNAL_RUNLEVEL) {
+        runlevel_switch(value);
+        return;
+    }
+
+    if (container_mode && (signal == SIGTERM || signal == SIGINT || signal == SIGUSR1 || signal == SIGUSR2)) {
+        console_info("stopping container\r\n");
+        shutdown_container();
+        return;
+    }
+
     switch (signal) {
         case SIGTERM:
             console_info("reboot received\r\n");
-            svc_stopEnabledServices();
-            process_killEverything();
-            reboot(RB_AUTOBOOT);
+            shutdown_system(RB_AUTOBOOT);
             break;
         case SIGUSR2:
             console_info("poweroff received\r\n");
-            svc_stopEnabledServices();
-            process_killEverything();
-            reboot(RB_POWER_OFF);
+            shutdown_system(RB_POWER_OFF);
             break;
         case SIGUSR1:
             console_info("halt received\r\n");
-            svc_stopEnabledServices();
-            process_killEverything();
-            reboot(RB_HALT_SYSTEM);
+            shutdown_system(RB_HALT_SYSTEM);
             break;
         case SIGCHLD:
-            while (waitpid(0, NULL, WNOHANG) >= 0)
-                ;
+            process_reap();
             break;
         default:
             break;
@@ -84,28 +97,54 @@ static void sigHandler(int signal) {
 }
 
 /**
- * @brief Setup signals needed for init
+ * @brief Reads pending signals from signalfd and handles them in the event loop
  * 
+ * @param fd signalfd
+ * @param events unused
+ * @param data unused
  */
-void signals_setup() {
-    struct sigaction sa = {
-        .sa_handler = sigHandler,
-        .sa_flags = SA_RESTART,
-    };
-
-    sigset_t dftsigset;  // default sigset
-
-    sigemptyset(&sa.sa_mask);
-    sigaddset(&sa.sa_mask, SIGCHLD);
-    sigprocmask(SIG_BLOCK, &sa.sa_mask, &dftsigset);
-
-    char signals[] = {SIGTERM, SIGINT, SIGPWR, SIGHUP, SIGUSR1, SIGUSR2, SIGKILL, SIGCHLD};
-    for (uint8_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++) {
-        sigaddset(&sa.sa_mask, signals[i]);
-        sigaction(signals[i], &sa, NULL);
+static void readSignals(int fd, uint32_t events, void* data) {
+    struct signalfd_siginfo info[8];
+    ssize_t n;
+
+    while ((n = read(fd, info, sizeof(info))) > 0) {
+        uint8_t chld = 0;
+        for (size_t i = 0; i < n / sizeof(info[0]); i++) {
+            if (info[i].ssi_signo == SIGCHLD)
+                chld = 1;  // one reap drains every exited child
+            else
+                handleSignal(info[i].ssi_signo, info[i].ssi_int);
+        }
+        if (chld)
+            handleSignal(SIGCHLD, 0);
     }
+}
+
+/**
+ * @brief Setup signals needed for init
+ * Signals are blocked and delivered through signalfd to the event loop,
+ * so the handlers don't run in signal context.
+ * @param container 1 in container mode, termination signals stop services and init exits
+ */
+void signals_setup(uint8_t container) {
+    container_mode = container;
+
+    sigset_t set;
+    sigemptyset(&set);
+
+    char signals[] = {SIGTERM, SIGINT, SIGPWR, SIGHUP, SIGUSR1, SIGUSR2, SIGCHLD};
+    for (uint8_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++)
+        sigaddset(&set, signals[i]);
+    sigaddset(&set, SIGNAL_RUNLEVEL);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+
+    int fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0)
+        console_error("failed creating signalfd: %s\r\n", strerror(errno));
+    else
+        loop_addFd(fd, EPOLLIN, readSignals, NULL);
 
-    if (DISABLE_CAD == 1)  // if DISABLE_CAD set to 1 then disable Ctrl-Alt-Del reboot
+    if (DISABLE_CAD == 1 && !container)  // if DISABLE_CAD set to 1 then disable Ctrl-Alt-Del reboot
         reboot(RB_DISABLE_CAD);
 
     setsid();
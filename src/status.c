@@ -0,0 +1,187 @@
+/**
+ * @file status.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "status.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "console.h"
+#include "process.h"
+#include "utilities.h"
+
+static struct status_header* header = NULL;  // mapping of STATUS_FILE, NULL if it isn't available
+static struct status_entry* entries = NULL;
+
+/**
+ * @brief Creates the status page, readers map STATUS_FILE read only
+ * 
+ */
+void status_init() {
+    size_t size = sizeof(struct status_header) + STATUS_MAXENTRIES * sizeof(struct status_entry);
+
+    util_dirCreate(RUN_DIR, 0755);
+    int fd = open(STATUS_FILE, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        console_error("failed creating %s: %s\r\n", STATUS_FILE, strerror(errno));
+        return;
+    }
+    if (ftruncate(fd, size) < 0) {  // pages of unused entries are never touched
+        console_error("failed creating %s: %s\r\n", STATUS_FILE, strerror(errno));
+        close(fd);
+        return;
+    }
+
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        console_error("failed mapping %s: %s\r\n", STATUS_FILE, strerror(errno));
+        return;
+    }
+
+    header = (struct status_header*)map;
+    entries = (struct status_entry*)(header + 1);
+    header->version = STATUS_VERSION;
+    header->entry_size = sizeof(struct status_entry);
+    header->count = 0;
+    __atomic_store_n(&header->magic, STATUS_MAGIC, __ATOMIC_RELEASE);  // readers check it last
+}
+
+/**
+ * @brief Marks start of writing the entry
+ * 
+ * @param e entry
+ */
+static inline void writeBegin(struct status_entry* e) {
+    __atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Marks end of writing the entry
+ * 
+ * @param e entry
+ */
+static inline void writeEnd(struct status_entry* e) {
+    __atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Allocates entry in the status page
+ * 
+ * @param kind STATUS_KIND_SERVICE or STATUS_KIND_TTY
+ * @param name name of the service or path of the tty
+ * @return int slot or -1 if status page is full or unavailable
+ */
+int status_slot(uint8_t kind, const char* name) {
+    if (!header)
+        return -1;
+
+    uint32_t slot = 0;
+    while (slot < header->count && entries[slot].kind != STATUS_KIND_FREE)  // reuse released entries
+        slot++;
+    if (slot == STATUS_MAXENTRIES) {
+        console_error("status page is full, %s isn't published\r\n", name);
+        return -1;
+    }
+
+    struct status_entry* e = &entries[slot];
+    writeBegin(e);
+    e->kind = kind;
+    e->state = 0;
+    e->pid = 0;
+    e->exit_code = 0;
+    e->exit_signal = 0;
+    e->restarts = 0;
+    e->started = 0;
+    e->runs = 0;
+    e->cpu_user = 0;
+    e->cpu_sys = 0;
+    e->wall = 0;
+    e->maxrss = 0;
+    e->majflt = 0;
+    e->nvcsw = 0;
+    e->nivcsw = 0;
+    snprintf(e->name, sizeof(e->name), "%s", name);
+    writeEnd(e);
+
+    if (slot == header->count)
+        __atomic_store_n(&header->count, slot + 1, __ATOMIC_RELEASE);
+    return slot;
+}
+
+/**
+ * @brief Publishes status of the service or tty
+ * 
+ * @param slot slot from status_slot, ignored if it's -1
+ * @param state SERVICE_* or TTY_STATE_*
+ * @param pid PID of the process
+ * @param started timestamp when it was started
+ * @param exit_code exit code of the last run
+ * @param exit_signal signal which killed the last run
+ * @param restarts number of restarts
+ */
+void status_set(int slot, uint8_t state, pid_t pid, time_t started, int exit_code, int exit_signal, uint32_t restarts) {
+    if (slot < 0 || !header)
+        return;
+
+    struct status_entry* e = &entries[slot];
+    writeBegin(e);
+    e->state = state;
+    e->pid = pid;
+    e->started = started;
+    e->exit_code = exit_code;
+    e->exit_signal = exit_signal;
+    e->restarts = restarts;
+    writeEnd(e);
+}
+
+/**
+ * @brief Publishes resources used by the service
+ * 
+ * @param slot slot from status_slot, ignored if it's -1
+ * @param usage totals of the service
+ */
+void status_setUsage(int slot, const struct process_usage* usage) {
+    if (slot < 0 || !header)
+        return;
+
+    struct status_entry* e = &entries[slot];
+    writeBegin(e);
+    e->runs = usage->runs;
+    e->cpu_user = usage->user;
+    e->cpu_sys = usage->sys;
+    e->wall = usage->wall;
+    e->maxrss = usage->maxrss;
+    e->majflt = usage->majflt;
+    e->nvcsw = usage->nvcsw;
+    e->nivcsw = usage->nivcsw;
+    writeEnd(e);
+}
+
+/**
+ * @brief Frees the entry eg. when hotplugged tty is removed
+ * 
+ * @param slot slot from status_slot, ignored if it's -1
+ */
+void status_release(int slot) {
+    if (slot < 0 || !header)
+        return;
+
+    struct status_entry* e = &entries[slot];
+    writeBegin(e);
+    e->kind = STATUS_KIND_FREE;
+    writeEnd(e);
+}
@@ -9,7 +9,6 @@
  */
 #include "svc.h"
 
-#include <dirent.h>
 #include <errno.h>
 #include <limits.h>
 #include <stdint.h>
@@ -18,10 +17,26 @@
 #include <string.h>
 #include <sys/wait.h>
 
+#include "activation.h"
+#include "arena.h"
+#include "batch.h"
+#include "cgroup.h"
 #include "config.h"
 #include "console.h"
+#include "control.h"
+#include "history.h"
+#include "loop.h"
+#include "metrics.h"
 #include "process.h"
+#include "runlevel.h"
+#include "shutdown.h"
 #include "signals.h"
+#include "status.h"
+#include "svcconf.h"
+#include "svcscan.h"
+#include "timeline.h"
+#include "topology.h"
+#include "trace.h"
 #include "tty.h"
 #include "utilities.h"
 
@@ -29,71 +44,88 @@ const char* AVAILABLE_DIR = "/etc/quickinit/services/available";
 const char* ENABLED_DIR = "/etc/quickinit/services/enabled";
 
 struct service_node* service_head = NULL;  // head of the list
+static struct arena svc_arena = {NULL};    // plans of the services
+static uint8_t emergency = 0;              // 1 while emergency shell runs, services aren't started
+static uint16_t job_slots = 0;             // maximum number of running start scripts, 0 for no limit
+static uint16_t starting = 0;              // number of running start scripts
+static uint8_t stopping_all = 0;           // 1 once services are stopped at shutdown
+
+/*! \cond PRIVATE */
+static struct {
+    uint8_t active;                // 1 while services of the old runlevel are being stopped
+    uint8_t old, new;              // runlevels
+    struct service_node* next;     // next service which may have to be stopped
+    struct service_node* waiting;  // service whose stop script is running
+} switching = {0};
+/*! \endcond */
 
 /**
- * @brief Adds service to the list
- * 
- * @param head head of the list
- * @param priority_start start priority of the service
- * @param priority_stop stop priority of the service
- * @param name name of the service
+ * @brief Checks if the service is started before the other one
+ * Within a priority, services which took longer in previous boots go first,
+ * so the longest start scripts don't end up last (longest processing time first).
+ * @param a service
+ * @param b service
+ * @return uint8_t 1 if a goes before b
  */
-static void addToList(struct service_node** head, uint16_t priority_start, uint16_t priority_stop, const char* name) {
-    struct service_node* new_service = (struct service_node*)malloc(sizeof(struct service_node));
-
-    new_service->pid = 0;
-    new_service->time = 0;
-    new_service->state = SERVICE_STOPPED;
-    new_service->priority_start = priority_start;
-    new_service->priority_stop = priority_stop;
-    strcpy(new_service->name, name);
-
-    new_service->next = *head;
-    *head = new_service;
+static uint8_t startsBefore(const struct service_node* a, const struct service_node* b) {
+    if (a->priority_start != b->priority_start)
+        return a->priority_start < b->priority_start;
+    return a->learned > b->learned;
 }
 
-static struct service_node* list_prevNode(struct service_node* a) {
-    if (service_head == a) {
-        return NULL;
-    }
-    struct service_node* temp = service_head;  // temp is current node
-    struct service_node* prev_a = NULL;
+/**
+ * @brief Checks if the service is stopped before the other one
+ * 
+ * @param a service
+ * @param b service
+ * @return uint8_t 1 if a goes before b
+ */
+static uint8_t stopsBefore(const struct service_node* a, const struct service_node* b) {
+    return a->priority_stop < b->priority_stop;
+}
 
-    while (temp && temp != a) {  // search until find null or a node
-        prev_a = temp;           // find previous node
-        temp = temp->next;
+/**
+ * @brief Merges two sorted lists, equal services keep their order
+ * 
+ * @param a sorted list
+ * @param b sorted list, its services were after those of a
+ * @param before comparison
+ * @return struct service_node* merged list
+ */
+static struct service_node* mergeSorted(struct service_node* a, struct service_node* b, uint8_t (*before)(const struct service_node*, const struct service_node*)) {
+    struct service_node* head = NULL;
+    struct service_node** tail = &head;
+    while (a != NULL && b != NULL) {
+        if (before(b, a)) {
+            *tail = b;
+            b = b->next;
+        } else {
+            *tail = a;
+            a = a->next;
+        }
+        tail = &(*tail)->next;
     }
-    return prev_a;
+    *tail = a != NULL ? a : b;
+    return head;
 }
 
 /**
- * @brief Swaps two services at the list
+ * @brief Stable merge sort of the list
  * 
- * @param a pointer to service node
- * @param b pointer to service node
+ * @param head head of the list
+ * @param before comparison
+ * @return struct service_node* new head
  */
-void service_swapServices(struct service_node** a, struct service_node** b) {
-    if ((service_head) == NULL || (*a) == NULL || (*b) == NULL)
-        return;
-
-    // find previous nodes
-    struct service_node* prev_a = list_prevNode(*a);
-    struct service_node* prev_b = list_prevNode(*b);
-
-    if (prev_a) prev_a->next = (*b);  // prev a is prev b
-    if (prev_b) prev_b->next = (*a);  // prev b is prev a
+static struct service_node* sortList(struct service_node* head, uint8_t (*before)(const struct service_node*, const struct service_node*)) {
+    if (head == NULL || head->next == NULL)
+        return head;
 
-    // swap next fields
-    struct service_node* temp = NULL;
-    temp = (*a)->next;
-    (*a)->next = (*b)->next;
-    (*b)->next = temp;
-
-    //if a or b was head, swap head
-    if ((service_head) == (*a))
-        service_head = *b;
-    else if ((service_head) == (*b))
-        service_head = *a;
+    struct service_node* slow = head;  // find the middle
+    for (struct service_node* fast = head->next; fast != NULL && fast->next != NULL; fast = fast->next->next)
+        slow = slow->next;
+    struct service_node* second = slow->next;
+    slow->next = NULL;
+    return mergeSorted(sortList(head, before), sortList(second, before), before);
 }
 
 /**
@@ -101,13 +133,7 @@ void service_swapServices(struct service_node** a, struct service_node** b) {
  * 
  */
 static void sortServicesAscendingByStartPriority() {
-    for (struct service_node* temp1 = service_head; temp1 != NULL; temp1 = temp1->next) {
-        for (struct service_node* temp2 = temp1->next; temp2 != NULL; temp2 = temp2->next) {
-            if (temp2->priority_start < temp1->priority_start) {
-                service_swapServices(&temp1, &temp2);
-            }
-        }
-    }
+    service_head = sortList(service_head, startsBefore);
 }
 
 /**
@@ -115,13 +141,7 @@ static void sortServicesAscendingByStartPriority() {
  * 
  */
 static void sortServicesAscendingByStopPriority() {
-    for (struct service_node* temp1 = service_head; temp1 != NULL; temp1 = temp1->next) {
-        for (struct service_node* temp2 = temp1->next; temp2 != NULL; temp2 = temp2->next) {
-            if (temp2->priority_stop < temp1->priority_stop) {
-                service_swapServices(&temp1, &temp2);
-            }
-        }
-    }
+    service_head = sortList(service_head, stopsBefore);
 }
 
 /**
@@ -173,23 +193,6 @@ static uint8_t exists(struct service_node* node, const char* name) {
     return result;
 }
 
-/**
- * @brief Searches for the service by name
- * 
- * @param node service_head
- * @param name name of the service
- * @return struct service_node* pointer to the service if found, otherwise null
- */
-static struct service_node* findByName(struct service_node* node, const char* name) {
-    while (node != NULL) {
-        if (strcmp(name, node->name) == 0) {
-            return node;
-        }
-        node = node->next;
-    }
-    return NULL;
-}
-
 /**
  * @brief Register new service (only if it doesn't exist)
  * 
@@ -199,7 +202,7 @@ static struct service_node* findByName(struct service_node* node, const char* na
  */
 inline static void registerService(uint16_t priority_start, uint16_t priority_stop, const char* name) {
     if (!exists(service_head, name)) {
-        addToList(&service_head, priority_start, priority_stop, name);
+        svcscan_add(&service_head, priority_start, priority_stop, name);
     }
 }
 
@@ -230,10 +233,21 @@ inline static uint8_t dirExists(const char* dirpath) {
     }
 }
 
+/**
+ * @brief Publishes service in the status page
+ * 
+ * @param node service
+ */
+static void publishService(const struct service_node* node) {
+    TRACE(state, node->name, node->state, node->pid);
+    control_serviceChanged(node->name);
+    status_set(node->status_slot, node->state, node->pid, node->time, node->exit_code, node->exit_signal, node->restarts);
+    status_setUsage(node->status_slot, &node->usage);
+}
+
 /**
  * @brief Updates service indexed by name and priority with provided data 
  * 
- * @param head head of the list
  * @param pid pid of the service
  * @param time time when started
  * @param state state of the service
@@ -241,6 +255,7 @@ inline static uint8_t dirExists(const char* dirpath) {
  * @param priority_stop start priority of the service
  * @param name name of the service
  */
+
 static void updateData(pid_t pid, time_t time, uint8_t state, uint16_t priority_start, uint16_t priority_stop, const char* name) {
     struct service_node* node = service_head;
     while (node != NULL) {
@@ -248,6 +263,7 @@ static void updateData(pid_t pid, time_t time, uint8_t state, uint16_t priority_
             node->pid = pid;
             node->time = time;
             node->state = state;
+            publishService(node);
             return;
         }
         node = node->next;
@@ -255,91 +271,89 @@ static void updateData(pid_t pid, time_t time, uint8_t state, uint16_t priority_
 }
 
 /**
- * @brief Updates service with provided data 
+ * @brief Scans directory with start (S) and stop (K) links and adds services to the list
+ * Doesn't spawn anything, so it can be used outside of init.
+ * @param dirpath directory eg. ENABLED_DIR
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t svc_scan(const char* dirpath) {
+    return svcscan_dir(dirpath, &service_head);
+}
+
+/**
+ * @brief Checks if the service is a template, eg. S050worker@
  * 
- * @param head head of the list
- * @param pid pid of the service
- * @param time time when started
- * @param state state of the service
- * @param priority_start start priority of the service
- * @param priority_stop start priority of the service
- * @param name name of the service
+ * @param node service
+ * @return uint8_t 1 if it is
  */
-static void updateDataByPointer(struct service_node** node, pid_t pid, time_t time, uint8_t state, uint16_t priority_start, uint16_t priority_stop, const char* name) {
-    if (*node != NULL) {
-        (*node)->pid = pid;
-        (*node)->time = time;
-        (*node)->state = state;
-        (*node)->priority_start = priority_start;
-        (*node)->priority_stop = priority_stop;
-        strcpy((*node)->name, name);
-    }
-}
-
-/**
- * @brief Scan /etc/quickinit/services/enabled for enabled services and register them
- * 
- * @return uint8_t EXIT_FAILURE or EXIT_SUCCESS
- */
-static uint8_t scanAndAddEnabledServices() {
-    DIR* d = opendir(ENABLED_DIR);
-
-    if (d) {
-        struct dirent* dir;
-        while ((dir = readdir(d)) != NULL) {
-            if (dir->d_type == DT_REG || dir->d_type == DT_LNK) {
-                size_t namelen = strlen(dir->d_name);
-                int16_t priority_start = 0, priority_stop = 0;
-                char* prio_to_int_status = NULL;  // used for strtol checking
-
-                if (namelen < 5) {
-                    console_error("Skipped service! Filename isn't valid!\r\n");
-                    continue;  // skip this service
-                }
-
-                char* buf = (char*)malloc((namelen + 1) * sizeof(char));  // alloc buffer for filename
-                strcpy(buf, dir->d_name);                                 // copy name to a buffer
-
-                if (buf[0] == 'S') {                                                      // check if first character of the file name is S (start)
-                    char* buf_prio = (char*)malloc((namelen + 1) * sizeof(char));         // alloc start priority buffer
-                    strcpy(buf_prio, buf + 1);                                            // copy buffer, skipping first character (S) into start priority buffer
-                    buf_prio[3] = 0;                                                      // add \0 just after the number ends, so you can use the buffer with strtol
-                    priority_start = (int16_t)strtol(buf_prio, &prio_to_int_status, 10);  // convert to integer base 10
-                    free(buf_prio);
-                } else if (buf[0] == 'K') {                                              // if first char is K
-                    char* buf_prio = (char*)malloc((namelen + 1) * sizeof(char));        // alloc start priority buffer
-                    strcpy(buf_prio, buf + 1);                                           // copy buffer, skipping first character (S) into start priority buffer
-                    buf_prio[3] = 0;                                                     // add \0 just after the number ends, so you can use the buffer with strtol
-                    priority_stop = (int16_t)strtol(buf_prio, &prio_to_int_status, 10);  // convert to integer base 10
-                    free(buf_prio);
-                }
-                if (*prio_to_int_status != '\0') {
-                    console_error("Skipped service! Priority isn't valid!\r\n");
-                    continue;  // skip this service
-                }
-
-                if (priority_start != 0) {
-                    if (!exists(service_head, buf + 4)) {
-                        registerService((uint16_t)priority_start, 0, buf + 4);  // register service with priority, buf+3 is name without S or K and priority (4 characters)
-                    } else {
-                        struct service_node* tmp = findByName(service_head, buf + 4);
-                        updateDataByPointer(&tmp, 0, 0, SERVICE_STOPPED, (uint16_t)priority_start, tmp->priority_stop, buf + 4);  // update service with proper data
-                    }
-                } else if (priority_stop != 0) {
-                    if (!exists(service_head, buf + 4)) {
-                        registerService(0, (uint16_t)priority_stop, buf + 4);
-                    } else {
-                        struct service_node* tmp = findByName(service_head, buf + 4);
-                        updateDataByPointer(&tmp, 0, 0, SERVICE_STOPPED, tmp->priority_start, (uint16_t)priority_stop, buf + 4);
-                    }
-                }
-                free(buf);
-            }
+static inline uint8_t isTemplate(const struct service_node* node) {
+    size_t len = strlen(node->name);
+    return node->instance < 0 && node->name[len - 1] == SVC_TEMPLATE_CHAR;
+}
+
+/**
+ * @brief Replaces the template with its instances, they inherit its links, script and configuration
+ * 
+ * @param link pointer to the template in the list
+ * @return struct service_node** pointer to the link after the last instance
+ */
+static struct service_node** expandTemplate(struct service_node** link) {
+    struct service_node* tmpl = *link;
+    *link = tmpl->next;
+
+    svcconf_load(AVAILABLE_DIR, tmpl);
+    if (tmpl->listen_count != 0) {  // instances would fight for the same sockets
+        console_error("%s: templates can't have listen=, skipped\r\n", tmpl->name);
+        svcconf_free(tmpl);
+        free(tmpl);
+        return link;
+    }
+    if (tmpl->is_main) {
+        console_error("%s: templates can't have main=yes\r\n", tmpl->name);
+        tmpl->is_main = 0;
+    }
+
+    uint16_t count = tmpl->instances ? tmpl->instances : 1;
+    for (uint16_t i = 0; i < count; i++) {
+        struct service_node* instance = (struct service_node*)malloc(sizeof(struct service_node));
+        if (!instance) {
+            console_error("no memory for service %s\r\n", tmpl->name);
+            break;
         }
-        closedir(d);
-        return EXIT_SUCCESS;
-    } else {
-        return EXIT_FAILURE;
+        if (svcconf_copy(instance, tmpl) != EXIT_SUCCESS) {  // its own configuration may replace strings of the template
+            console_error("no memory for service %s\r\n", tmpl->name);
+            free(instance);
+            break;
+        }
+        if ((size_t)snprintf(instance->name, sizeof(instance->name), "%s%u", tmpl->name, i) >= sizeof(instance->name) || exists(service_head, instance->name)) {
+            console_error("%s%u: name is too long or already used, instance skipped\r\n", tmpl->name, i);
+            svcconf_free(instance);
+            free(instance);
+            continue;
+        }
+        instance->instance = i;
+        instance->instances = 0;
+
+        instance->next = *link;
+        *link = instance;
+        link = &instance->next;
+    }
+    svcconf_free(tmpl);
+    free(tmpl);
+    return link;
+}
+
+/**
+ * @brief Expands all templates found by svc_scan
+ * 
+ */
+static void expandTemplates() {
+    struct service_node** link = &service_head;
+    while (*link != NULL) {
+        if (isTemplate(*link))
+            link = expandTemplate(link);
+        else
+            link = &(*link)->next;
     }
 }
 
@@ -388,96 +402,1051 @@ static uint8_t findStopExec(uint16_t priority_stop, const char* name, char* buf)
 }
 
 /**
- * @brief Starts all enabled services
+ * @brief Resolves start and stop scripts of the service and builds plans for spawning them
  * 
+ * @param node service
  */
-static void startEnabledServices() {
-    sortServicesAscendingByStartPriority();
+static void buildPlans(struct service_node* node) {
+    char resource[PATH_MAX];
+    char cmd[PATH_MAX + sizeof(" start")];
+    char link[SERVICENAME_MAXLEN];  // instances use links and scripts of their template
 
-    struct service_node* temp = service_head;
+    snprintf(link, sizeof(link), "%s", node->name);
+    if (node->instance >= 0)
+        strrchr(link, SVC_TEMPLATE_CHAR)[1] = '\0';
 
-    while (temp != NULL) {
-        if (temp->priority_start == 0) {  // skip if don't need starting
-            temp = temp->next;
-            continue;
+    if (node->priority_start != 0 && findStartExec(node->priority_start, link, resource) == EXIT_SUCCESS) {
+        snprintf(cmd, sizeof(cmd), "%s start", resource);
+        if (process_buildPlan(&svc_arena, &node->start_plan, cmd, NULL) != EXIT_SUCCESS)
+            node->start_plan.path = NULL;
+    }
+    if (node->priority_stop != 0 && findStopExec(node->priority_stop, link, resource) == EXIT_SUCCESS) {
+        snprintf(cmd, sizeof(cmd), "%s stop", resource);
+        if (process_buildPlan(&svc_arena, &node->stop_plan, cmd, NULL) != EXIT_SUCCESS)
+            node->stop_plan.path = NULL;
+    }
+    if (node->health_cmd && process_buildPlan(&svc_arena, &node->health_plan, node->health_cmd, NULL) != EXIT_SUCCESS)
+        node->health_plan.path = NULL;
+
+    const char* procs = node->start_plan.path ? cgroup_create(node->name) : NULL;
+    if (procs)  // daemons started by the start script stay in its cgroup
+        node->start_plan.cgroup = arena_strdup(&svc_arena, procs);
+
+    if (node->instance < 0)
+        return;
+
+    char entry[sizeof("INSTANCE=") + 8];
+    snprintf(entry, sizeof(entry), "INSTANCE=%d", node->instance);
+    struct process_plan* plans[] = {&node->start_plan, &node->stop_plan, &node->health_plan};
+    for (size_t i = 0; i < sizeof(plans) / sizeof(plans[0]); i++) {
+        if (plans[i]->path && process_addEnv(&svc_arena, plans[i], entry) != EXIT_SUCCESS)
+            plans[i]->path = NULL;
+    }
+
+    if (node->affinity != TOPOLOGY_NONE && node->start_plan.path) {  // children of the start script inherit it
+        struct topology_cpus* cpus = (struct topology_cpus*)arena_alloc(&svc_arena, sizeof(struct topology_cpus));
+        if (cpus && topology_cpuSet(node->affinity, node->instance, cpus) == EXIT_SUCCESS)
+            node->start_plan.affinity = cpus;
+        else
+            console_error("%s: failed choosing CPUs, instance isn't pinned\r\n", node->name);
+    }
+}
+
+static void armHealth(struct service_node* node);
+static void startQueued();
+
+/**
+ * @brief Exit reported for a process which couldn't be forked
+ * 
+ */
+static const struct process_exit spawn_failed = {.pid = -1, .code = PROCESS_EXEC_FAILED};
+
+/**
+ * @brief Checks if the service is periodic job
+ * 
+ * @param node service
+ * @return uint8_t 1 if it is
+ */
+static inline uint8_t isJob(const struct service_node* node) {
+    return node->interval > 0 || node->calendar_minute >= 0;
+}
+
+/**
+ * @brief Called by the reaper when start script of a service exits
+ * 
+ * @param owner pointer to service_node
+ * @param ex exit information
+ */
+static void serviceStarted(void* owner, const struct process_exit* ex) {
+    struct service_node* node = (struct service_node*)owner;
+    double now = util_monotonicTime();
+
+    loop_cancelTimer(node->timer);
+    node->timer = NULL;
+    node->batched = 0;
+    starting--;
+    metrics_observe(METRICS_SVC_START, now - node->mono_time);
+    process_addUsage(&node->usage, ex, now - node->mono_time);
+    timeline_add("service", node->name, node->mono_time, now, &node->usage);
+    node->exit_code = ex->code;
+    node->exit_signal = ex->signal;
+    node->pid = 0;  // start script has exited
+    startQueued();
+    if (node->state == SERVICE_TIMEDOUT) {  // killed by startTimedOut
+        publishService(node);
+        return;
+    }
+    if (ex->code == 0 && !isJob(node))
+        history_record(node->name, now - node->mono_time);
+    if (isJob(node)) {
+        node->state = node->job_timer ? SERVICE_SCHEDULED : SERVICE_STOPPED;
+        publishService(node);
+    } else {
+        node->state = SERVICE_STARTED;
+        publishService(node);
+        armHealth(node);
+    }
+    if (ex->code != 0)
+        console_error("%s start exited with code=%d signal=%d\r\n", node->name, ex->code, ex->signal);
+}
+
+/**
+ * @brief Called by the batch shell when PID of the subshell running start script is known
+ * 
+ * @param owner pointer to service_node
+ * @param pid PID of the subshell
+ */
+static void batchStarted(void* owner, pid_t pid) {
+    struct service_node* node = (struct service_node*)owner;
+    if (!node->batched)  // already exited
+        return;
+    node->pid = pid;
+    publishService(node);
+}
+
+/**
+ * @brief Called by the reaper when emergency shell exits, services can be started again
+ * 
+ * @param owner unused
+ * @param ex unused
+ */
+static void emergencyExited(void* owner, const struct process_exit* ex) {
+    emergency = 0;
+    console_info("leaving emergency mode\r\n");
+    startQueued();
+}
+
+/**
+ * @brief Spawns emergency shell on the console, services aren't started until it exits
+ * 
+ */
+static void enterEmergency() {
+    if (emergency)
+        return;
+
+    struct process_plan plan;
+    console_error("entering emergency mode, services won't be started until %s exits\r\n", EMERGENCY_SHELL);
+    if (process_buildPlan(&svc_arena, &plan, EMERGENCY_SHELL, MSG_CONSOLE) != EXIT_SUCCESS) {
+        console_error("failed spawning %s\r\n", EMERGENCY_SHELL);
+        return;
+    }
+    pid_t pid = process_spawn(&plan);
+    if (pid < 0) {
+        console_error("failed spawning %s\r\n", EMERGENCY_SHELL);
+        return;
+    }
+    emergency = 1;
+    process_watch(pid, emergencyExited, NULL);
+}
+
+/**
+ * @brief Start script of the service didn't finish in time, kills its process group
+ * Boot doesn't wait for the service anymore, on_timeout decides what happens next.
+ * @param data pointer to service_node
+ */
+static void startTimedOut(void* data) {
+    struct service_node* node = (struct service_node*)data;
+
+    node->timer = NULL;
+    if (node->state != SERVICE_STARTING)
+        return;
+    console_error("%s start timed out after %.1f s, killing it\r\n", node->name, node->start_timeout);
+    metrics_inc(METRICS_SVC_TIMEOUTS);
+    if (node->pid > 0)  // batched script has no PID until its subshell reports it
+        kill(node->batched ? node->pid : -node->pid, SIGKILL);  // start script is a session leader, its children are in its group
+    node->state = SERVICE_TIMEDOUT;
+    publishService(node);
+
+    if (node->on_timeout == SVC_ON_TIMEOUT_EMERGENCY)
+        enterEmergency();
+}
+
+static void socketReady(int fd, uint32_t events, void* data);
+
+/**
+ * @brief Watches listening sockets of the service in the event loop
+ * 
+ * @param node service
+ */
+static void watchSockets(struct service_node* node) {
+    for (uint8_t i = 0; i < node->listen_count; i++)
+        loop_addFd(node->listen_fds[i], EPOLLIN, socketReady, node);
+    node->listen_watched = 1;
+    node->state = SERVICE_LISTENING;
+    publishService(node);
+}
+
+/**
+ * @brief Stops watching listening sockets, they stay open
+ * 
+ * @param node service
+ */
+static void unwatchSockets(struct service_node* node) {
+    if (!node->listen_watched)
+        return;
+    for (uint8_t i = 0; i < node->listen_count; i++)
+        loop_removeFd(node->listen_fds[i]);
+    node->listen_watched = 0;
+}
+
+/**
+ * @brief Closes listening sockets of the service
+ * 
+ * @param node service
+ */
+static void closeSockets(struct service_node* node) {
+    unwatchSockets(node);
+    for (uint8_t i = 0; i < node->listen_count; i++) {
+        if (node->listen_fds[i] >= 0)
+            close(node->listen_fds[i]);
+        node->listen_fds[i] = -1;
+    }
+}
+
+/**
+ * @brief Opens listening sockets of socket activated service, the service is started on first connection
+ * 
+ * @param node service
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t listenService(struct service_node* node) {
+    for (uint8_t i = 0; i < node->listen_count; i++) {
+        if (node->listen_fds[i] < 0)
+            node->listen_fds[i] = activation_open(node->listen[i]);
+        if (node->listen_fds[i] < 0) {
+            closeSockets(node);
+            return EXIT_FAILURE;
         }
+    }
+    watchSockets(node);
+    console_debug("%s is waiting for connections\r\n", node->name);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Called by the reaper when socket activated service exits, sockets are watched again
+ * 
+ * @param owner pointer to service_node
+ * @param ex exit information
+ */
+static void activatedExited(void* owner, const struct process_exit* ex) {
+    struct service_node* node = (struct service_node*)owner;
+    double now = util_monotonicTime();
 
-        char resource[PATH_MAX];
+    process_addUsage(&node->usage, ex, now - node->mono_time);
+    timeline_add("activated", node->name, node->mono_time, now, &node->usage);
+    node->exit_code = ex->code;
+    node->exit_signal = ex->signal;
+    node->pid = 0;
+    if (node->state != SERVICE_STARTED) {
+        publishService(node);
+        return;
+    }
 
-        if (findStartExec(temp->priority_start, temp->name, resource) != EXIT_SUCCESS) {
-            temp = temp->next;
-            continue;
+    node->state = SERVICE_LISTENING;
+    publishService(node);
+    if (util_monotonicTime() - node->mono_time >= SVC_ACTIVATION_INTERVAL)
+        watchSockets(node);  // otherwise the tick watches them, so a failing daemon isn't restarted in a loop
+}
+
+/**
+ * @brief Watches sockets of activated services which exited too quickly
+ * 
+ */
+static void svcTick() {
+    for (struct service_node* node = service_head; node != NULL; node = node->next) {
+        if (node->state == SERVICE_LISTENING && !node->listen_watched)
+            watchSockets(node);
+    }
+}
+
+/**
+ * @brief First connection arrived, starts the service with the listening sockets
+ * 
+ * @param fd listening socket
+ * @param events unused
+ * @param data pointer to service_node
+ */
+static void socketReady(int fd, uint32_t events, void* data) {
+    struct service_node* node = (struct service_node*)data;
+
+    unwatchSockets(node);
+    if (!node->start_plan.path) {
+        closeSockets(node);
+        node->state = SERVICE_STOPPED;
+        publishService(node);
+        return;
+    }
+    console_debug("%s activated\r\n", node->name);
+    if (node->mono_time != 0) {  // it was started before
+        TRACE(respawn, node->name, node->restarts);
+        node->restarts++;
+    }
+
+    pid_t pid = process_spawnWithFds(&node->start_plan, node->listen_fds, node->listen_count);
+    updateData(pid, time(NULL), SERVICE_STARTED, node->priority_start, node->priority_stop, node->name);
+    node->mono_time = util_monotonicTime();
+    if (pid < 0)
+        activatedExited(node, &spawn_failed);  // it listens again after SVC_ACTIVATION_INTERVAL
+    else
+        process_watch(pid, activatedExited, node);
+}
+
+/**
+ * @brief Checks start conditions of the service in init, so nothing is spawned when one fails
+ * 
+ * @param node service
+ * @return uint8_t 1 if all conditions are satisfied
+ */
+static uint8_t conditionsMet(struct service_node* node) {
+    for (uint8_t i = 0; i < node->condition_count; i++) {
+        const struct condition* c = &node->conditions[i];
+        if (!condition_check(c)) {
+            console_info("%s skipped, %s=%s%s failed\r\n", node->name, condition_name(c->type), c->negate ? "!" : "", c->arg);
+            node->state = SERVICE_CONDITION_FAILED;
+            publishService(node);
+            return 0;
         }
-        char* cmdbuf = (char*)malloc((strlen(resource) + strlen(" start") + 1) * sizeof(char));  // alloc buffer for command
-        sprintf(cmdbuf, "%s start", resource);                                                   // append start to command buffer
-        console_debug("%s \r\n", cmdbuf);
+    }
+    return 1;
+}
+
+/**
+ * @brief Called by the reaper when main service exits, the container is stopped
+ * 
+ * @param owner pointer to service_node
+ * @param ex exit information
+ */
+static void mainExited(void* owner, const struct process_exit* ex) {
+    struct service_node* node = (struct service_node*)owner;
+    double now = util_monotonicTime();
+
+    process_addUsage(&node->usage, ex, now - node->mono_time);
+    node->exit_code = ex->code;
+    node->exit_signal = ex->signal;
+    node->pid = 0;
+    node->state = SERVICE_STOPPED;
+    publishService(node);
+    console_info("main service %s exited with code=%d signal=%d\r\n", node->name, ex->code, ex->signal);
+    shutdown_container();
+}
 
-        pid_t pid = process_execute(cmdbuf);
-        updateData(pid, time(NULL), SERVICE_STARTING, temp->priority_start, temp->priority_stop, temp->name);  // set status as starting
-        free(cmdbuf);
+/**
+ * @brief Spawns start script of the service with its timeout
+ * Main service runs in foreground, so it is started at once and has no timeout.
+ * @param temp service
+ */
+static void spawnStart(struct service_node* temp) {
+    if (!temp->is_main && job_slots != 0 && starting >= job_slots) {  // started by startQueued when a slot is free
+        temp->queued = 1;
+        updateData(0, time(NULL), SERVICE_STARTING, temp->priority_start, temp->priority_stop, temp->name);
+        return;
+    }
+    console_debug("%s start\r\n", temp->start_plan.path);
+    if (temp->mono_time != 0) {  // it was started before
+        TRACE(respawn, temp->name, temp->restarts);
+        temp->restarts++;
+    }
 
-        temp = temp->next;
+    if (temp->is_main) {
+        pid_t pid = process_spawn(&temp->start_plan);
+        updateData(pid, time(NULL), SERVICE_STARTED, temp->priority_start, temp->priority_stop, temp->name);
+        temp->mono_time = util_monotonicTime();
+        if (pid < 0)
+            mainExited(temp, &spawn_failed);
+        else
+            process_watch(pid, mainExited, temp);
+        return;
     }
+
+    starting++;
+    temp->batched = temp->batchable && temp->instance < 0 &&  // instances need INSTANCE in their environment
+                    batch_submit(temp->start_plan.path, "start", temp->start_plan.cgroup, batchStarted, serviceStarted, temp) == EXIT_SUCCESS;
+    pid_t pid = temp->batched ? 0 : process_spawn(&temp->start_plan);
+    updateData(pid, time(NULL), SERVICE_STARTING, temp->priority_start, temp->priority_stop, temp->name);  // set status as starting
+    temp->mono_time = util_monotonicTime();
+    if (pid < 0) {
+        serviceStarted(temp, &spawn_failed);
+        return;
+    }
+    if (!temp->batched)
+        process_watch(pid, serviceStarted, temp);
+    if (temp->start_timeout > 0)
+        temp->timer = loop_addTimer(temp->start_timeout, startTimedOut, temp);
 }
 
 /**
- * @brief Stops all enabled services
+ * @brief Spawns queued start scripts while there are free job slots, in start order
  * 
  */
-void svc_stopEnabledServices() {
-    sortServicesAscendingByStopPriority();
+static void startQueued() {
+    while (!emergency && (job_slots == 0 || starting < job_slots)) {
+        struct service_node* next = NULL;
+        for (struct service_node* node = service_head; node != NULL; node = node->next) {
+            if (node->queued && (next == NULL || startsBefore(node, next)))
+                next = node;
+        }
+        if (next == NULL)
+            return;
+        next->queued = 0;
+        spawnStart(next);
+    }
+}
+
+/**
+ * @brief Computes time until the next run of periodic job
+ * 
+ * @param node service
+ * @return double seconds
+ */
+static double nextRun(const struct service_node* node) {
+    if (node->interval > 0)
+        return node->interval;
 
-    struct service_node* temp = service_head;
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    tm.tm_sec = 0;
+    tm.tm_min = node->calendar_minute;
+    if (node->calendar_hour >= 0)
+        tm.tm_hour = node->calendar_hour;
 
-    while (temp != NULL) {
-        if (temp->priority_stop == 0 || temp->state != SERVICE_STARTED) {  // skip if don't need stopping or it isn't running
-            temp = temp->next;
-            continue;
+    time_t next = mktime(&tm);
+    while (next <= now) {  // mktime normalizes overflowing hour and day
+        if (node->calendar_hour >= 0)
+            tm.tm_mday++;
+        else
+            tm.tm_hour++;
+        tm.tm_isdst = -1;
+        next = mktime(&tm);
+    }
+    return difftime(next, now);
+}
+
+static void jobDue(void* data);
+
+/**
+ * @brief Schedules the next run of periodic job
+ * 
+ * @param node service
+ */
+static void scheduleJob(struct service_node* node) {
+    node->job_timer = loop_addTimer(nextRun(node), jobDue, node);
+}
+
+/**
+ * @brief Runs periodic job, the run is skipped if the previous one hasn't finished
+ * 
+ * @param data pointer to service_node
+ */
+static void jobDue(void* data) {
+    struct service_node* node = (struct service_node*)data;
+
+    scheduleJob(node);  // the next run doesn't depend on how long this one takes
+    if (node->state == SERVICE_STARTING) {
+        console_error("%s is still running, its run is skipped\r\n", node->name);
+        return;
+    }
+    if (emergency || !conditionsMet(node))
+        return;
+    metrics_inc(METRICS_JOB_RUNS);
+    spawnStart(node);
+}
+
+/**
+ * @brief Spawns start script of the service, it is started when the script exits
+ * Socket activated services only get their sockets opened, periodic jobs are scheduled.
+ * @param temp service
+ */
+static void startService(struct service_node* temp) {
+    if (emergency)
+        return;
+    if (!conditionsMet(temp))
+        return;
+    if (temp->listen_count > 0) {
+        listenService(temp);
+        return;
+    }
+
+    if (!temp->start_plan.path)
+        return;
+    if (isJob(temp)) {
+        scheduleJob(temp);
+        temp->state = SERVICE_SCHEDULED;
+        publishService(temp);
+        return;
+    }
+    spawnStart(temp);
+}
+
+/**
+ * @brief Kills start script of the service or takes it out of the queue, its exit isn't reported
+ * 
+ * @param node starting service
+ */
+static void cancelStart(struct service_node* node) {
+    loop_cancelTimer(node->timer);
+    node->timer = NULL;
+    if (node->queued) {
+        node->queued = 0;
+        return;
+    }
+    if (node->batched) {
+        batch_cancel(node);
+    } else if (node->pid > 0) {
+        kill(-node->pid, SIGKILL);  // start script is a session leader, its children are in its group
+        process_unwatch(node->pid);
+    }
+    node->batched = 0;
+    starting--;
+}
+
+/**
+ * @brief Cancels timers and health check of the service and closes its sockets, before its stop script runs
+ * 
+ * @param temp service
+ * @return uint8_t 1 if the stop script has to run, 0 if the service is already stopped
+ */
+static uint8_t stopPrepare(struct service_node* temp) {
+    if (temp->state == SERVICE_FROZEN) {  // its processes must handle the stop
+        cgroup_freeze(temp->name, 0);
+        temp->state = SERVICE_STARTED;
+    }
+
+    loop_cancelTimer(temp->job_timer);
+    temp->job_timer = NULL;
+    loop_cancelTimer(temp->health_timer);
+    temp->health_timer = NULL;
+    if (temp->health_pid > 0) {
+        kill(-temp->health_pid, SIGKILL);
+        process_unwatch(temp->health_pid);
+        temp->health_pid = 0;
+    }
+
+    if (temp->state == SERVICE_STARTING) {  // it hasn't started, so there is nothing to stop
+        cancelStart(temp);
+        updateData(0, 0, SERVICE_STOPPED, temp->priority_start, temp->priority_stop, temp->name);
+        return 0;
+    }
+
+    if (temp->listen_count > 0) {
+        closeSockets(temp);
+        if (temp->state != SERVICE_STARTED) {  // nobody has connected yet
+            updateData(0, 0, SERVICE_STOPPED, temp->priority_start, temp->priority_stop, temp->name);
+            return 0;
         }
+        process_unwatch(temp->pid);  // activated daemon is terminated after the stop script
+    }
+    return 1;
+}
 
-        char resource[PATH_MAX];
+/**
+ * @brief Limits timeout of stop script at shutdown by the deadline
+ * 
+ * @param timeout timeout of the script [seconds], 0 if it can run forever
+ * @param deadline monotonic time, 0 for none
+ * @return double timeout [seconds], 0 if the script can run forever, negative if the deadline has passed
+ */
+static double stopBudget(double timeout, double deadline) {
+    if (deadline <= 0)
+        return timeout;
+    double left = deadline - util_monotonicTime();
+    if (left <= 0)
+        return -1;
+    return timeout > 0 && timeout < left ? timeout : left;
+}
 
-        if (findStopExec(temp->priority_stop, temp->name, resource) != EXIT_SUCCESS) {
-            temp = temp->next;
+/**
+ * @brief Runs stop script of the service and waits for it, used at shutdown
+ * 
+ * @param temp service
+ * @param deadline monotonic time by which the script is killed, 0 for none
+ */
+static void stopService(struct service_node* temp, double deadline) {
+    uint8_t state = SERVICE_STOPPED;
+
+    if (!stopPrepare(temp))
+        return;
+    pid_t activated = temp->listen_count > 0 ? temp->pid : 0;  // running socket activated daemon
+
+    if (temp->stop_plan.path) {
+        console_debug("%s stop\r\n", temp->stop_plan.path);
+
+        double started = util_monotonicTime();
+        double timeout = stopBudget(temp->stop_timeout, deadline);
+        struct process_exit ex;
+        pid_t pid = process_spawn(&temp->stop_plan);
+        if (pid < 0) {
+            temp->exit_code = PROCESS_EXEC_FAILED;
+            temp->exit_signal = 0;
+        } else if (process_waitFor(pid, &ex, timeout) == EXIT_SUCCESS) {  // wait for the stop script, so it isn't killed at shutdown
+            temp->exit_code = ex.code;
+            temp->exit_signal = ex.signal;
+            process_addUsage(&temp->usage, &ex, util_monotonicTime() - started);
+        } else if (timeout > 0) {
+            console_error("%s stop timed out after %.1f s, killing it\r\n", temp->name, timeout);
+            metrics_inc(METRICS_SVC_TIMEOUTS);
+            kill(-pid, SIGKILL);  // it is reaped by the reaper
+            state = SERVICE_TIMEDOUT;
+        }
+        metrics_observe(METRICS_SVC_STOP, util_monotonicTime() - started);
+    }
+    if (activated > 0)
+        kill(activated, SIGTERM);
+
+    updateData(0, 0, state, temp->priority_start, temp->priority_stop, temp->name);
+}
+
+/**
+ * @brief Marks the service stopped after its stop script, socket activated daemon is terminated
+ * 
+ * @param node service
+ * @param state SERVICE_STOPPED or SERVICE_TIMEDOUT
+ */
+static void stopFinish(struct service_node* node, uint8_t state) {
+    if (node->listen_count > 0 && node->pid > 0)
+        kill(node->pid, SIGTERM);
+    updateData(0, 0, state, node->priority_start, node->priority_stop, node->name);
+}
+
+static void continueSwitch();
+
+/**
+ * @brief Called by the reaper when stop script which runs in the background exits
+ * Service is started again if it's in the current runlevel, eg. it was unhealthy or the runlevel has changed back
+ * meanwhile. Runlevel switch which waits for the service continues.
+ * @param owner pointer to service_node
+ * @param ex exit information
+ */
+static void stopExited(void* owner, const struct process_exit* ex) {
+    struct service_node* node = (struct service_node*)owner;
+    double now = util_monotonicTime();
+    uint8_t timed_out = node->stop_timeout > 0 && !node->timer;  // stopTimedOut has fired
+
+    loop_cancelTimer(node->timer);
+    node->timer = NULL;
+    node->stop_pid = 0;
+    metrics_observe(METRICS_SVC_STOP, now - node->mono_time);
+    process_addUsage(&node->usage, ex, now - node->mono_time);
+    node->exit_code = ex->code;
+    node->exit_signal = ex->signal;
+    stopFinish(node, timed_out ? SERVICE_TIMEDOUT : SERVICE_STOPPED);
+    if (stopping_all)
+        return;
+
+    if (node->priority_start != 0 && RUNLEVEL_IN(node->runlevels, runlevel_current()))
+        startService(node);
+    if (switching.waiting == node) {
+        switching.waiting = NULL;
+        continueSwitch();
+    }
+}
+
+/**
+ * @brief Kills stop script which didn't exit in time, the service is stopped when the script is reaped
+ * 
+ * @param data pointer to service_node
+ */
+static void stopTimedOut(void* data) {
+    struct service_node* node = (struct service_node*)data;
+
+    node->timer = NULL;
+    console_error("%s stop timed out after %.1f s, killing it\r\n", node->name, node->stop_timeout);
+    metrics_inc(METRICS_SVC_TIMEOUTS);
+    kill(-node->stop_pid, SIGKILL);
+}
+
+/**
+ * @brief Stops the service, its stop script runs in the background so init isn't blocked
+ * Its timeout is a loop timer and stopExited finishes the stop.
+ * @param node service
+ * @return uint8_t 1 if the stop script runs, 0 if the service is already stopped
+ */
+static uint8_t stopAsync(struct service_node* node) {
+    if (!stopPrepare(node))
+        return 0;
+
+    if (node->stop_plan.path) {
+        console_debug("%s stop\r\n", node->stop_plan.path);
+        node->mono_time = util_monotonicTime();
+        node->stop_pid = process_spawn(&node->stop_plan);
+        if (node->stop_pid > 0) {
+            process_watch(node->stop_pid, stopExited, node);
+            if (node->stop_timeout > 0)
+                node->timer = loop_addTimer(node->stop_timeout, stopTimedOut, node);
+            node->state = SERVICE_STOPPING;
+            publishService(node);
+            return 1;
+        }
+        node->stop_pid = 0;
+        node->exit_code = PROCESS_EXEC_FAILED;
+        node->exit_signal = 0;
+    }
+    stopFinish(node, SERVICE_STOPPED);
+    return 0;
+}
+
+/**
+ * @brief Restarts the service, stopExited starts it when its stop script exits
+ * 
+ * @param node started service
+ */
+static void restartService(struct service_node* node) {
+    if (!stopAsync(node))
+        startService(node);
+}
+
+/**
+ * @brief Counts failed health check, restarts the service after health_retries failures in a row
+ * 
+ * @param node service
+ */
+static void healthFailed(struct service_node* node) {
+    metrics_inc(METRICS_HEALTH_FAILURES);
+    node->health_failures++;
+    console_error("%s health check failed (%u/%u)\r\n", node->name, node->health_failures, node->health_retries);
+    if (node->health_failures < node->health_retries)
+        return;
+
+    console_error("%s is unhealthy, restarting it\r\n", node->name);
+    node->health_failures = 0;
+    restartService(node);
+}
+
+/**
+ * @brief Called by the reaper when health check exits
+ * 
+ * @param owner pointer to service_node
+ * @param ex exit information
+ */
+static void healthExited(void* owner, const struct process_exit* ex) {
+    struct service_node* node = (struct service_node*)owner;
+
+    node->health_pid = 0;
+    if (ex->code == 0)
+        node->health_failures = 0;
+    else if (node->state == SERVICE_STARTED)
+        healthFailed(node);
+}
+
+/**
+ * @brief Spawns health check, the previous one fails if it's still running
+ * 
+ * @param data pointer to service_node
+ */
+static void healthDue(void* data) {
+    struct service_node* node = (struct service_node*)data;
+
+    node->health_timer = NULL;
+    if (node->state != SERVICE_STARTED)
+        return;
+    armHealth(node);
+    if (node->health_pid > 0) {  // hung check counts as failure
+        kill(-node->health_pid, SIGKILL);
+        process_unwatch(node->health_pid);
+        node->health_pid = 0;
+        healthFailed(node);
+        return;
+    }
+
+    node->health_pid = process_spawn(&node->health_plan);
+    if (node->health_pid < 0) {
+        node->health_pid = 0;
+        healthFailed(node);
+        return;
+    }
+    process_watch(node->health_pid, healthExited, node);
+}
+
+/**
+ * @brief Schedules the next health check of running service
+ * 
+ * @param node service
+ */
+static void armHealth(struct service_node* node) {
+    if (node->health_plan.path && !node->health_timer)
+        node->health_timer = loop_addTimer(node->health_interval, healthDue, node);
+}
+
+/**
+ * @brief Starts all enabled services of current runlevel
+ * 
+ */
+static void startEnabledServices() {
+    sortServicesAscendingByStartPriority();
+
+    uint8_t level = runlevel_current();
+    for (struct service_node* temp = service_head; temp != NULL; temp = temp->next) {
+        if (temp->priority_start == 0 || !RUNLEVEL_IN(temp->runlevels, level))  // skip if don't need starting
             continue;
+        startService(temp);
+    }
+}
+
+/**
+ * @brief Waits for stop script which runs in the background, it's killed when its timeout or the deadline passes
+ * 
+ * @param node stopping service
+ * @param deadline monotonic time, 0 for none
+ */
+static void awaitStop(struct service_node* node, double deadline) {
+    double timeout = -1;
+    if (node->stop_timeout == 0)
+        timeout = stopBudget(0, deadline);
+    else if (node->mono_time + node->stop_timeout > util_monotonicTime())
+        timeout = stopBudget(node->mono_time + node->stop_timeout - util_monotonicTime(), deadline);
+    struct process_exit ex;
+    if (timeout >= 0 && process_waitFor(node->stop_pid, &ex, timeout) == EXIT_SUCCESS) {
+        stopExited(node, &ex);
+        return;
+    }
+    loop_cancelTimer(node->timer);
+    stopTimedOut(node);  // it is reaped by the reaper
+}
+
+/**
+ * @brief Stops all enabled services
+ * Stop scripts are waited for one after another, each at most until the deadline. Once it passes,
+ * the remaining services are left to be killed with everything else.
+ * @param deadline monotonic time, 0 for none
+ */
+void svc_stopEnabledServices(double deadline) {
+    stopping_all = 1;
+    switching.active = 0;  // the rest of the switch doesn't matter
+    switching.next = switching.waiting = NULL;
+    sortServicesAscendingByStopPriority();
+    for (struct service_node* temp = service_head; temp != NULL; temp = temp->next) {
+        if (temp->queued) {  // never started
+            temp->queued = 0;
+            updateData(0, 0, SERVICE_STOPPED, temp->priority_start, temp->priority_stop, temp->name);
         }
-        char* cmdbuf = (char*)malloc((strlen(resource) + strlen(" stop") + 1) * sizeof(char));  // alloc buffer for command
-        sprintf(cmdbuf, "%s stop", resource);
-        console_debug("%s \r\n", cmdbuf);
+    }
 
-        process_execute(cmdbuf);
-        updateData(0, 0, SERVICE_STOPPED, temp->priority_start, temp->priority_stop, temp->name);
-        free(cmdbuf);
+    for (struct service_node* temp = service_head; temp != NULL; temp = temp->next) {
+        if (deadline > 0 && util_monotonicTime() >= deadline) {
+            console_error("services weren't stopped in time, skipping the remaining stop scripts\r\n");
+            break;
+        }
+        if (temp->state == SERVICE_STOPPING) {
+            awaitStop(temp, deadline);
+            continue;
+        }
+        if (temp->priority_stop == 0 || (temp->state != SERVICE_STARTED && temp->state != SERVICE_FROZEN))  // skip if don't need stopping or it isn't running
+            continue;
+        stopService(temp, deadline);
+    }
+}
+
+/**
+ * @brief Continues runlevel switch, stops services of the old runlevel one after another
+ * Their stop scripts run in the background, the switch continues when stopExited reaps them.
+ * Once they're stopped, services of the new runlevel are started.
+ */
+static void continueSwitch() {
+    while (switching.next != NULL) {
+        struct service_node* temp = switching.next;
+        switching.next = temp->next;
+        if ((temp->state == SERVICE_STARTED || temp->state == SERVICE_STARTING || temp->state == SERVICE_LISTENING || temp->state == SERVICE_SCHEDULED || temp->state == SERVICE_FROZEN) && RUNLEVEL_IN(temp->runlevels, switching.old) && !RUNLEVEL_IN(temp->runlevels, switching.new) && stopAsync(temp)) {
+            switching.waiting = temp;
+            return;
+        }
+    }
+    switching.active = 0;
 
-        temp = temp->next;
+    sortServicesAscendingByStartPriority();
+    for (struct service_node* temp = service_head; temp != NULL; temp = temp->next) {
+        if (temp->priority_start != 0 && (temp->state == SERVICE_STOPPED || temp->state == SERVICE_CONDITION_FAILED || temp->state == SERVICE_TIMEDOUT) && !RUNLEVEL_IN(temp->runlevels, switching.old) && RUNLEVEL_IN(temp->runlevels, switching.new))
+            startService(temp);
     }
+    startQueued();  // slots of cancelled start scripts
+
+    if (runlevel_current() != switching.new)  // runlevel was changed again meanwhile
+        svc_switchRunlevel(switching.new, runlevel_current());
 }
 
 /**
- * @brief Wait until all services are running
+ * @brief Stops services which aren't in the new runlevel and starts those which weren't in the old one
+ * New services are started in parallel, the same way as at boot. Init isn't blocked by stop scripts,
+ * a switch requested meanwhile follows when this one is done.
+ * @param old previous runlevel
+ * @param new new runlevel
+ */
+void svc_switchRunlevel(uint8_t old, uint8_t new) {
+    if (switching.active || stopping_all)  // continueSwitch switches to the current runlevel when it's done
+        return;
+    switching.active = 1;
+    switching.old = old;
+    switching.new = new;
+    sortServicesAscendingByStopPriority();
+    switching.next = service_head;
+    continueSwitch();
+}
+
+/**
+ * @brief Wait until services are running
  * 
+ * @param console_only 1 if only services with before_console are waited for
  */
-void svc_waitForAll() {
+static void waitForServices(uint8_t console_only) {
     struct service_node* node = service_head;
     while (node != NULL) {
-        while (node->state == SERVICE_STARTING) {
-            int stat;
-            waitpid(node->pid, &stat, WUNTRACED);
-            updateData(node->pid, node->time, SERVICE_STARTED, node->priority_start, node->priority_stop, node->name);  // change state to started
+        while (node->state == SERVICE_STARTING && (!console_only || node->before_console)) {
+            loop_runOnce();  // the reaper changes state to started
         }
         node = node->next;
     }
 }
 
+/**
+ * @brief Returns exit status of the main service as a shell would
+ * 
+ * @return int exit code, 128 + signal if it was killed, 0 if there is no main service
+ */
+int svc_mainStatus() {
+    for (struct service_node* node = service_head; node != NULL; node = node->next) {
+        if (node->is_main)
+            return node->exit_signal ? 128 + node->exit_signal : node->exit_code;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Returns state of the service
+ * 
+ * @param name name of the service
+ * @param state output, SERVICE_*
+ * @param exit_code output, last exit code
+ * @param exit_signal output, signal which killed it last time, otherwise 0
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE if there is no such service
+ */
+uint8_t svc_getState(const char* name, uint8_t* state, int* exit_code, int* exit_signal) {
+    for (struct service_node* node = service_head; node != NULL; node = node->next) {
+        if (strcmp(node->name, name) == 0) {
+            *state = node->state;
+            *exit_code = node->exit_code;
+            *exit_signal = node->exit_signal;
+            return EXIT_SUCCESS;
+        }
+    }
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief Freezes or thaws running services in their cgroups
+ * Frozen services keep their memory and caches, health checks are paused.
+ * @param target name of the service or its group
+ * @param freeze 1 freezes, 0 thaws
+ * @return int number of frozen or thawed services, -1 if no service or group has the name
+ */
+int svc_freeze(const char* target, uint8_t freeze) {
+    int changed = -1;
+    for (struct service_node* node = service_head; node != NULL; node = node->next) {
+        if (strcmp(node->name, target) != 0 && strcmp(node->group, target) != 0)
+            continue;
+        if (changed < 0)
+            changed = 0;
+        if (!node->start_plan.cgroup)
+            continue;
+
+        if (freeze && node->state == SERVICE_STARTED && cgroup_populated(node->name) && cgroup_freeze(node->name, 1) == EXIT_SUCCESS) {  // empty cgroup would be frozen without effect
+            node->state = SERVICE_FROZEN;
+        } else if (!freeze && node->state == SERVICE_FROZEN && cgroup_freeze(node->name, 0) == EXIT_SUCCESS) {
+            node->state = SERVICE_STARTED;
+            armHealth(node);
+        } else {
+            continue;
+        }
+        publishService(node);
+        changed++;
+    }
+    return changed;
+}
+
+/**
+ * @brief Wait until all services are running
+ * 
+ */
+void svc_waitForAll() {
+    waitForServices(0);
+}
+
+/**
+ * @brief Wait until services with before_console=yes are running, others keep starting
+ * 
+ */
+void svc_waitForConsole() {
+    waitForServices(1);
+}
+
+/**
+ * @brief Reads limit of start scripts running at once
+ * 
+ * @return uint16_t JOB_SLOTS or quickinit.jobs= from kernel cmdline, 0 for no limit
+ */
+static uint16_t jobSlots() {
+    char buf[8];
+    if (util_cmdlineGet("quickinit.jobs", buf, sizeof(buf)) != EXIT_SUCCESS)
+        return JOB_SLOTS;
+    char* end;
+    long slots = strtol(buf, &end, 10);
+    if (end == buf || *end != '\0' || slots < 0 || slots > UINT16_MAX) {
+        console_error("invalid quickinit.jobs=%s\r\n", buf);
+        return JOB_SLOTS;
+    }
+    return slots;
+}
+
 /**
  * @brief Initializes service spawning
  * 
+ * @param container 1 in container mode, otherwise main= is ignored
  */
-void svc_init() {
+void svc_init(uint8_t container) {
     if (!dirExists(AVAILABLE_DIR) && !dirExists(ENABLED_DIR)) {
         return;
     }
-    scanAndAddEnabledServices();
+    svc_scan(ENABLED_DIR);
+    expandTemplates();
+    cgroup_init();
+    history_load();
+    job_slots = jobSlots();
+    for (struct service_node* node = service_head; node != NULL; node = node->next) {
+        svcconf_load(AVAILABLE_DIR, node);
+        node->learned = history_get(node->name);
+        if (node->is_main && !container) {
+            console_error("%s: main=yes is used only in container mode\r\n", node->name);
+            node->is_main = 0;
+        }
+        if (node->instances != 0 || (node->affinity != TOPOLOGY_NONE && node->instance < 0)) {
+            console_error("%s: instances= and affinity= are used only in templates\r\n", node->name);
+            node->instances = 0;
+            node->affinity = node->instance < 0 ? TOPOLOGY_NONE : node->affinity;
+        }
+        buildPlans(node);
+        node->status_slot = status_slot(STATUS_KIND_SERVICE, node->name);
+        publishService(node);
+    }
     startEnabledServices();
+    loop_addTick(svcTick);
     listAll(service_head);
 }
\ No newline at end of file
@@ -0,0 +1,509 @@
+/**
+ * @file svcconf.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "svcconf.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "activation.h"
+#include "condition.h"
+#include "console.h"
+#include "runlevel.h"
+#include "topology.h"
+
+/**
+ * @brief Parses runlevels= key
+ * 
+ * @param node service
+ * @param value value of the key
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseRunlevels(struct service_node* node, const char* value) {
+    return runlevel_parse(value, &node->runlevels);
+}
+
+/**
+ * @brief Parses listen= key, can be specified multiple times
+ * 
+ * @param node service
+ * @param value unix:/path, tcp:[address:]port or udp:[address:]port
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseListen(struct service_node* node, const char* value) {
+    if (node->listen_count >= SVC_MAX_LISTEN || activation_validate(value) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    char* spec = strdup(value);
+    if (!spec)
+        return EXIT_FAILURE;
+    node->listen[node->listen_count++] = spec;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Parses timeout in seconds, 0 disables it
+ * 
+ * @param value value of the key
+ * @param out timeout
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseTimeout(const char* value, double* out) {
+    char* end;
+    double timeout = strtod(value, &end);
+    if (end == value || *end != '\0' || !(timeout >= 0) || timeout > 86400)
+        return EXIT_FAILURE;
+    *out = timeout;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Parses start_timeout= key
+ * 
+ * @param node service
+ * @param value seconds, 0 disables the timeout
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseStartTimeout(struct service_node* node, const char* value) {
+    return parseTimeout(value, &node->start_timeout);
+}
+
+/**
+ * @brief Parses stop_timeout= key
+ * 
+ * @param node service
+ * @param value seconds, 0 disables the timeout
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseStopTimeout(struct service_node* node, const char* value) {
+    return parseTimeout(value, &node->stop_timeout);
+}
+
+/**
+ * @brief Parses on_timeout= key
+ * 
+ * @param node service
+ * @param value continue or emergency
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseOnTimeout(struct service_node* node, const char* value) {
+    if (strcmp(value, "continue") == 0)
+        node->on_timeout = SVC_ON_TIMEOUT_CONTINUE;
+    else if (strcmp(value, "emergency") == 0)
+        node->on_timeout = SVC_ON_TIMEOUT_EMERGENCY;
+    else
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Parses interval= key, the service becomes periodic job
+ * 
+ * @param node service
+ * @param value seconds between runs
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseInterval(struct service_node* node, const char* value) {
+    if (node->calendar_minute >= 0 || parseTimeout(value, &node->interval) != EXIT_SUCCESS)
+        return EXIT_FAILURE;  // calendar= can't be used together
+    return node->interval > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Parses calendar= key, the service becomes periodic job
+ * 
+ * @param node service
+ * @param value HH:MM daily or *:MM hourly, local time
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseCalendar(struct service_node* node, const char* value) {
+    int hour = -1, minute, len = 0;
+    if (node->interval > 0)
+        return EXIT_FAILURE;  // interval= can't be used together
+    if (value[0] == '*') {
+        if (sscanf(value, "*:%2d%n", &minute, &len) != 1)
+            return EXIT_FAILURE;
+    } else if (sscanf(value, "%2d:%2d%n", &hour, &minute, &len) != 2 || hour < 0 || hour > 23) {
+        return EXIT_FAILURE;
+    }
+    if (value[len] != '\0' || minute < 0 || minute > 59)
+        return EXIT_FAILURE;
+    node->calendar_hour = hour;
+    node->calendar_minute = minute;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Parses health_cmd= key
+ * 
+ * @param node service
+ * @param value command with parameters, exit code 0 means healthy
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseHealthCmd(struct service_node* node, const char* value) {
+    if (*value == '\0')
+        return EXIT_FAILURE;
+    free(node->health_cmd);
+    node->health_cmd = strdup(value);
+    return node->health_cmd ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Parses health_interval= key
+ * 
+ * @param node service
+ * @param value seconds between health checks
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseHealthInterval(struct service_node* node, const char* value) {
+    double interval;
+    if (parseTimeout(value, &interval) != EXIT_SUCCESS || interval <= 0)
+        return EXIT_FAILURE;
+    node->health_interval = interval;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Parses health_retries= key
+ * 
+ * @param node service
+ * @param value number of failed checks in a row, 1-255
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseHealthRetries(struct service_node* node, const char* value) {
+    char* end;
+    long retries = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || retries < 1 || retries > 255)
+        return EXIT_FAILURE;
+    node->health_retries = retries;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Parses main= key
+ * 
+ * @param node service
+ * @param value yes or no
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseMain(struct service_node* node, const char* value) {
+    if (strcmp(value, "yes") == 0)
+        node->is_main = 1;
+    else if (strcmp(value, "no") == 0)
+        node->is_main = 0;
+    else
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Parses before_console= key
+ * 
+ * @param node service
+ * @param value yes or no
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseBeforeConsole(struct service_node* node, const char* value) {
+    if (strcmp(value, "yes") == 0)
+        node->before_console = 1;
+    else if (strcmp(value, "no") == 0)
+        node->before_console = 0;
+    else
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Parses group= key
+ * 
+ * @param node service
+ * @param value name of the group
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseGroup(struct service_node* node, const char* value) {
+    if (*value == '\0' || strlen(value) >= sizeof(node->group))
+        return EXIT_FAILURE;
+    snprintf(node->group, sizeof(node->group), "%s", value);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Parses batchable= key
+ * 
+ * @param node service
+ * @param value yes or no
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseBatchable(struct service_node* node, const char* value) {
+    if (strcmp(value, "yes") == 0)
+        node->batchable = 1;
+    else if (strcmp(value, "no") == 0)
+        node->batchable = 0;
+    else
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Parses instances= key
+ * 
+ * @param node template
+ * @param value ncpu for one instance per CPU or number of instances
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseInstances(struct service_node* node, const char* value) {
+    if (strcmp(value, "ncpu") == 0) {
+        node->instances = topology_cpuCount();
+        return EXIT_SUCCESS;
+    }
+    char* end;
+    long instances = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || instances < 1 || instances > SVC_MAX_INSTANCES)
+        return EXIT_FAILURE;
+    node->instances = instances;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Parses affinity= key
+ * 
+ * @param node template
+ * @param value cpu, numa or none
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseAffinity(struct service_node* node, const char* value) {
+    if (strcmp(value, "cpu") == 0)
+        node->affinity = TOPOLOGY_CPU;
+    else if (strcmp(value, "numa") == 0)
+        node->affinity = TOPOLOGY_NUMA;
+    else if (strcmp(value, "none") == 0)
+        node->affinity = TOPOLOGY_NONE;
+    else
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Adds start condition to the service, can be specified multiple times
+ * 
+ * @param node service
+ * @param type CONDITION_*
+ * @param value value of the key
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t addCondition(struct service_node* node, uint8_t type, const char* value) {
+    if (node->condition_count >= SVC_MAX_CONDITIONS)
+        return EXIT_FAILURE;
+    if (condition_parse(type, value, &node->conditions[node->condition_count]) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    node->condition_count++;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Parses condition_path_exists= key
+ * 
+ * @param node service
+ * @param value value of the key
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parsePathExists(struct service_node* node, const char* value) {
+    return addCondition(node, CONDITION_PATH_EXISTS, value);
+}
+
+/**
+ * @brief Parses condition_mountpoint= key
+ * 
+ * @param node service
+ * @param value value of the key
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseMountpoint(struct service_node* node, const char* value) {
+    return addCondition(node, CONDITION_MOUNTPOINT, value);
+}
+
+/**
+ * @brief Parses condition_kernel_cmdline= key
+ * 
+ * @param node service
+ * @param value value of the key
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseKernelCmdline(struct service_node* node, const char* value) {
+    return addCondition(node, CONDITION_KERNEL_CMDLINE, value);
+}
+
+/**
+ * @brief Parses condition_file_not_empty= key
+ * 
+ * @param node service
+ * @param value value of the key
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseFileNotEmpty(struct service_node* node, const char* value) {
+    return addCondition(node, CONDITION_FILE_NOT_EMPTY, value);
+}
+
+/**
+ * @brief Parses condition_virtualization= key
+ * 
+ * @param node service
+ * @param value value of the key
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t parseVirtualization(struct service_node* node, const char* value) {
+    return addCondition(node, CONDITION_VIRTUALIZATION, value);
+}
+
+/**
+ * @brief Known keys of service configuration file
+ * 
+ */
+static const struct {
+    const char* key;
+    uint8_t (*parse)(struct service_node* node, const char* value);
+} keys[] = {
+    {"runlevels", parseRunlevels},
+    {"listen", parseListen},
+    {"before_console", parseBeforeConsole},
+    {"main", parseMain},
+    {"batchable", parseBatchable},
+    {"group", parseGroup},
+    {"instances", parseInstances},
+    {"affinity", parseAffinity},
+    {"start_timeout", parseStartTimeout},
+    {"stop_timeout", parseStopTimeout},
+    {"on_timeout", parseOnTimeout},
+    {"interval", parseInterval},
+    {"calendar", parseCalendar},
+    {"health_cmd", parseHealthCmd},
+    {"health_interval", parseHealthInterval},
+    {"health_retries", parseHealthRetries},
+    {"condition_path_exists", parsePathExists},
+    {"condition_mountpoint", parseMountpoint},
+    {"condition_kernel_cmdline", parseKernelCmdline},
+    {"condition_file_not_empty", parseFileNotEmpty},
+    {"condition_virtualization", parseVirtualization},
+};
+
+/**
+ * @brief Copies the service, strings which svcconf_load may free are duplicated
+ * So configuration loaded into the copy, eg. instance of a template, doesn't free strings of the original.
+ * Arguments of conditions are shared, they're never freed.
+ * @param dst copy
+ * @param src original
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE if there's no memory, dst owns no strings then
+ */
+uint8_t svcconf_copy(struct service_node* dst, const struct service_node* src) {
+    *dst = *src;
+    dst->health_cmd = src->health_cmd ? strdup(src->health_cmd) : NULL;
+    uint8_t ok = !src->health_cmd || dst->health_cmd;
+    for (dst->listen_count = 0; ok && dst->listen_count < src->listen_count; dst->listen_count += ok) {
+        dst->listen[dst->listen_count] = strdup(src->listen[dst->listen_count]);
+        ok = dst->listen[dst->listen_count] != NULL;
+    }
+    if (ok)
+        return EXIT_SUCCESS;
+    svcconf_free(dst);
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief Frees strings of the service which were allocated by svcconf_load or svcconf_copy
+ * 
+ * @param node service
+ */
+void svcconf_free(struct service_node* node) {
+    free(node->health_cmd);
+    node->health_cmd = NULL;
+    for (uint8_t i = 0; i < node->listen_count; i++)
+        free(node->listen[i]);
+    node->listen_count = 0;
+}
+
+/**
+ * @brief Removes whitespace from both ends of a string
+ * 
+ * @param str string
+ * @return char* trimmed string
+ */
+static char* trim(char* str) {
+    while (isspace((unsigned char)*str))
+        str++;
+    char* end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1]))
+        end--;
+    *end = '\0';
+    return str;
+}
+
+/**
+ * @brief Loads optional configuration of the service from [dir]/[name].conf
+ * File format, one key per line:
+ * key=value
+ * @param dir directory with available services
+ * @param node service
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE if the file has errors
+ */
+uint8_t svcconf_load(const char* dir, struct service_node* node) {
+    char path[SVCCONF_MAX_LINELEN];
+    snprintf(path, sizeof(path), "%s/%s" SVCCONF_SUFFIX, dir, node->name);
+
+    FILE* fp = fopen(path, "r");
+    if (!fp)
+        return EXIT_SUCCESS;  // configuration is optional
+
+    char line[SVCCONF_MAX_LINELEN];
+    unsigned int lineno = 0;
+    uint8_t ret = EXIT_SUCCESS;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+        if (strchr(line, '\n') == NULL && !feof(fp)) {  // line is too long, skip the rest of it
+            int c;
+            while ((c = fgetc(fp)) != EOF && c != '\n')
+                ;
+            console_error("%s:%u: line is longer than %d characters\r\n", path, lineno, SVCCONF_MAX_LINELEN - 2);
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        char* key = trim(line);
+        if (*key == '\0' || *key == '#')
+            continue;
+
+        char* value = strchr(key, '=');
+        if (!value) {
+            console_error("%s:%u: expected key=value\r\n", path, lineno);
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        *value++ = '\0';
+        key = trim(key);
+        value = trim(value);
+
+        uint8_t known = 0;
+        for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+            if (strcmp(key, keys[i].key) == 0) {
+                known = 1;
+                if (keys[i].parse(node, value) != EXIT_SUCCESS) {
+                    console_error("%s:%u: invalid value of %s\r\n", path, lineno, key);
+                    ret = EXIT_FAILURE;
+                }
+                break;
+            }
+        }
+        if (!known) {
+            console_error("%s:%u: unknown key %s\r\n", path, lineno, key);
+            ret = EXIT_FAILURE;
+        }
+    }
+    fclose(fp);
+    return ret;
+}
@@ -0,0 +1,216 @@
+/**
+ * @file svcscan.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "svcscan.h"
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "console.h"
+#include "runlevel.h"
+#include "topology.h"
+#include "utilities.h"
+
+/**
+ * @brief Adds service to the list
+ * 
+ * @param head head of the list
+ * @param priority_start start priority of the service
+ * @param priority_stop stop priority of the service
+ * @param name name of the service
+ * @return struct service_node* new service or NULL
+ */
+struct service_node* svcscan_add(struct service_node** head, uint16_t priority_start, uint16_t priority_stop, const char* name) {
+    struct service_node* new_service = (struct service_node*)malloc(sizeof(struct service_node));
+    if (!new_service) {
+        console_error("no memory for service %s\r\n", name);
+        return NULL;
+    }
+
+    new_service->pid = 0;
+    new_service->time = 0;
+    new_service->mono_time = 0;
+    new_service->exit_code = 0;
+    new_service->exit_signal = 0;
+    new_service->state = SERVICE_STOPPED;
+    new_service->restarts = 0;
+    memset(&new_service->usage, 0, sizeof(new_service->usage));
+    new_service->status_slot = -1;
+    new_service->priority_start = priority_start;
+    new_service->priority_stop = priority_stop;
+    new_service->runlevels = RUNLEVEL_ALL;
+    new_service->listen_count = 0;
+    new_service->condition_count = 0;
+    new_service->before_console = 0;
+    new_service->batchable = 0;
+    new_service->group[0] = '\0';
+    new_service->batched = 0;
+    new_service->is_main = 0;
+    new_service->instances = 0;
+    new_service->instance = -1;
+    new_service->affinity = TOPOLOGY_NONE;
+    new_service->learned = 0;
+    new_service->queued = 0;
+    new_service->start_timeout = SVC_START_TIMEOUT;
+    new_service->stop_timeout = SVC_STOP_TIMEOUT;
+    new_service->on_timeout = SVC_ON_TIMEOUT_CONTINUE;
+    new_service->timer = NULL;
+    new_service->interval = 0;
+    new_service->calendar_hour = -1;
+    new_service->calendar_minute = -1;
+    new_service->job_timer = NULL;
+    new_service->health_cmd = NULL;
+    new_service->health_plan.path = NULL;
+    new_service->health_interval = SVC_HEALTH_INTERVAL;
+    new_service->health_retries = SVC_HEALTH_RETRIES;
+    new_service->health_failures = 0;
+    new_service->health_pid = 0;
+    new_service->health_timer = NULL;
+    new_service->stop_pid = 0;
+    new_service->listen_watched = 0;
+    for (uint8_t i = 0; i < SVC_MAX_LISTEN; i++)
+        new_service->listen_fds[i] = -1;
+    new_service->start_plan.path = NULL;
+    new_service->stop_plan.path = NULL;
+    snprintf(new_service->name, sizeof(new_service->name), "%s", name);
+
+    new_service->next = *head;
+    *head = new_service;
+    return new_service;
+}
+
+/**
+ * @brief Parses name of a link in enabled directory eg. S010network
+ * 
+ * @param filename name of the link
+ * @param priority_start output, start priority or 0 if it's a stop link
+ * @param priority_stop output, stop priority or 0 if it's a start link
+ * @return const char* name of the service or NULL if the filename isn't valid
+ */
+const char* svcscan_parseLinkName(const char* filename, uint16_t* priority_start, uint16_t* priority_stop) {
+    if (filename[0] != 'S' && filename[0] != 'K')
+        return NULL;
+
+    uint16_t priority = 0;
+    for (uint8_t i = 1; i <= 3; i++) {  // exactly three digits
+        if (filename[i] < '0' || filename[i] > '9')
+            return NULL;
+        priority = priority * 10 + (filename[i] - '0');
+    }
+
+    const char* name = filename + 4;
+    size_t namelen = strnlen(name, SERVICENAME_MAXLEN);
+    if (priority == 0 || namelen == 0 || namelen == SERVICENAME_MAXLEN)
+        return NULL;
+
+    *priority_start = filename[0] == 'S' ? priority : 0;
+    *priority_stop = filename[0] == 'K' ? priority : 0;
+    return name;
+}
+
+/**
+ * @brief Hash index of services by name, used while scanning so it isn't quadratic
+ * 
+ */
+struct name_index {
+    struct service_node** slots;
+    size_t size;  // always a power of two
+    size_t used;
+};
+
+/**
+ * @brief Searches service in the index
+ * 
+ * @param index index
+ * @param name name of the service
+ * @return struct service_node** slot with the service or empty slot where it belongs
+ */
+static struct service_node** indexSlot(struct name_index* index, const char* name) {
+    size_t i = util_hashName(name) & (index->size - 1);
+    while (index->slots[i] != NULL && strcmp(index->slots[i]->name, name) != 0)
+        i = (i + 1) & (index->size - 1);
+    return &index->slots[i];
+}
+
+/**
+ * @brief Adds service to the index, doubles its size when it's half full
+ * 
+ * @param index index
+ * @param node service
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t indexAdd(struct name_index* index, struct service_node* node) {
+    if ((index->used + 1) * 2 > index->size) {
+        struct name_index bigger = {NULL, index->size ? index->size * 2 : SVCSCAN_INDEX_MINSIZE, 0};
+        bigger.slots = (struct service_node**)calloc(bigger.size, sizeof(struct service_node*));
+        if (!bigger.slots)
+            return EXIT_FAILURE;
+        for (size_t i = 0; i < index->size; i++) {
+            if (index->slots[i] != NULL)
+                *indexSlot(&bigger, index->slots[i]->name) = index->slots[i];
+        }
+        bigger.used = index->used;
+        free(index->slots);
+        *index = bigger;
+    }
+    *indexSlot(index, node->name) = node;
+    index->used++;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Scans directory with start (S) and stop (K) links and adds services to the list
+ * Doesn't spawn anything, so it can be used outside of init.
+ * @param dirpath directory eg. ENABLED_DIR
+ * @param head head of the list
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t svcscan_dir(const char* dirpath, struct service_node** head) {
+    DIR* d = opendir(dirpath);
+    if (!d)
+        return EXIT_FAILURE;
+
+    struct name_index index = {NULL, 0, 0};
+    for (struct service_node* node = *head; node != NULL; node = node->next)
+        indexAdd(&index, node);
+
+    struct dirent* dir;
+    while ((dir = readdir(d)) != NULL) {
+        if (dir->d_type != DT_REG && dir->d_type != DT_LNK && dir->d_type != DT_UNKNOWN)
+            continue;
+        if (dir->d_name[0] == '.')
+            continue;
+
+        uint16_t priority_start, priority_stop;
+        const char* name = svcscan_parseLinkName(dir->d_name, &priority_start, &priority_stop);
+        if (!name) {
+            console_error("%s/%s: skipped, name must be S or K, 3 digit priority and service name\r\n", dirpath, dir->d_name);
+            continue;
+        }
+
+        struct service_node* node = index.size ? *indexSlot(&index, name) : NULL;
+        if (!node) {
+            node = svcscan_add(head, priority_start, priority_stop, name);
+            if (node && indexAdd(&index, node) != EXIT_SUCCESS) {
+                console_error("no memory for scanning %s\r\n", dirpath);
+                break;
+            }
+        } else if (priority_start != 0) {
+            node->priority_start = priority_start;
+        } else {
+            node->priority_stop = priority_stop;
+        }
+    }
+    free(index.slots);
+    closedir(d);
+    return EXIT_SUCCESS;
+}
@@ -1,10 +1,31 @@
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "config.h"
+#include "control.h"
+#include "recorder.h"
+#include "runlevel.h"
+#include "signals.h"
+#include "status.h"
+#include "svc.h"
+#include "tty.h"
+
+/*! \cond PRIVATE */
+#define WAIT_TIMEDOUT 2  // exit code of wait when the timeout passes
+/*! \endcond */
+
 typedef struct commandTable_s {
     uint8_t numArgs;  // number of arguments that the command needs to execute
     char name[10];    // command
@@ -16,34 +37,254 @@ static commandTable_s commandTable[] = {
     {0,
      "poweroff"},
     {0,
-     "reboot"}};
+     "reboot"},
+    {1,
+     "freeze"},
+    {1,
+     "thaw"},
+    {1,
+     "runlevel"},
+    {0,
+     "status"},
+    {0,
+     "trace"},
+    {1,
+     "wait"}};
+
+/**
+ * @brief Converts state of status entry to text
+ * 
+ * @param e status entry
+ * @return const char* name of the state
+ */
+static const char* stateName(const struct status_entry* e) {
+    if (e->kind == STATUS_KIND_SERVICE) {
+        switch (e->state) {
+            case SERVICE_STARTED:
+                return "started";
+            case SERVICE_STARTING:
+                return "starting";
+            case SERVICE_LISTENING:
+                return "listening";
+            case SERVICE_CONDITION_FAILED:
+                return "condition";
+            case SERVICE_TIMEDOUT:
+                return "timed out";
+            case SERVICE_SCHEDULED:
+                return "scheduled";
+            case SERVICE_FROZEN:
+                return "frozen";
+            case SERVICE_STOPPING:
+                return "stopping";
+            default:
+                return "stopped";
+        }
+    }
+    switch (e->state) {
+        case TTY_STATE_RUNNING:
+            return "running";
+        case TTY_STATE_WAITING:
+            return "waiting";
+        default:
+            return "stopped";
+    }
+}
+
+/**
+ * @brief Prints status of services and ttys from the status page, init isn't involved
+ * 
+ * @return int EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int printStatus() {
+    int fd = open(STATUS_FILE, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(STATUS_FILE);
+        return EXIT_FAILURE;
+    }
+    const void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+
+    const struct status_header* header = (const struct status_header*)map;
+    if ((size_t)st.st_size < sizeof(*header) || __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != STATUS_MAGIC ||
+        header->version != STATUS_VERSION || header->entry_size != sizeof(struct status_entry)) {
+        printf("Error: %s has unknown format!\r\n", STATUS_FILE);
+        return EXIT_FAILURE;
+    }
+    const struct status_entry* entries = (const struct status_entry*)(header + 1);
+    uint32_t count = __atomic_load_n(&header->count, __ATOMIC_ACQUIRE);
+    if (count > (st.st_size - sizeof(*header)) / sizeof(struct status_entry))
+        count = (st.st_size - sizeof(*header)) / sizeof(struct status_entry);
+
+    printf("%-24s %-8s %-10s %8s %8s %6s %s\r\n", "NAME", "TYPE", "STATE", "PID", "RESTARTS", "EXIT", "STARTED");
+    for (uint32_t i = 0; i < count; i++) {
+        struct status_entry e;
+        status_read(&entries[i], &e);
+        if (e.kind == STATUS_KIND_FREE)
+            continue;
+
+        char started[32] = "-";
+        time_t t = (time_t)e.started;
+        if (t != 0)
+            strftime(started, sizeof(started), "%Y-%m-%d %H:%M:%S", localtime(&t));
+        char exitstr[16];
+        if (e.exit_signal != 0)
+            snprintf(exitstr, sizeof(exitstr), "sig%d", e.exit_signal);
+        else
+            snprintf(exitstr, sizeof(exitstr), "%d", e.exit_code);
+
+        e.name[STATUS_NAMELEN - 1] = '\0';
+        printf("%-24s %-8s %-10s %8d %8u %6s %s\r\n", e.name, e.kind == STATUS_KIND_SERVICE ? "service" : "tty", stateName(&e),
+               e.pid, e.restarts, exitstr, started);
+    }
+
+    printf("\r\n%-24s %6s %9s %9s %9s %10s %8s %8s %8s\r\n", "SERVICE", "RUNS", "USER[s]", "SYS[s]", "WALL[s]", "MAXRSS[KB]", "MAJFLT", "VCSW", "IVCSW");
+    for (uint32_t i = 0; i < count; i++) {
+        struct status_entry e;
+        status_read(&entries[i], &e);
+        if (e.kind != STATUS_KIND_SERVICE || e.runs == 0)
+            continue;
+
+        e.name[STATUS_NAMELEN - 1] = '\0';
+        printf("%-24s %6u %9.3f %9.3f %9.3f %10lld %8lld %8lld %8lld\r\n", e.name, e.runs, e.cpu_user, e.cpu_sys, e.wall,
+               (long long)e.maxrss, (long long)e.majflt, (long long)e.nvcsw, (long long)e.nivcsw);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Prints events from the flight recorder of init, oldest first
+ * 
+ * @return int EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int printTrace() {
+    int fd = open(RECORDER_FILE, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(RECORDER_FILE);
+        return EXIT_FAILURE;
+    }
+    const void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+
+    const struct recorder_header* header = (const struct recorder_header*)map;
+    if ((size_t)st.st_size < sizeof(*header) || header->magic != RECORDER_MAGIC || header->version != RECORDER_VERSION ||
+        header->entry_size != sizeof(struct recorder_entry) || header->capacity != RECORDER_ENTRIES ||
+        (size_t)st.st_size < sizeof(*header) + RECORDER_ENTRIES * sizeof(struct recorder_entry)) {
+        printf("Error: %s has unknown format!\r\n", RECORDER_FILE);
+        return EXIT_FAILURE;
+    }
+    const struct recorder_entry* entries = (const struct recorder_entry*)(header + 1);
+    uint64_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > RECORDER_ENTRIES ? head - RECORDER_ENTRIES : 0;
+
+    for (uint64_t i = first; i < head; i++) {
+        struct recorder_entry e;
+        if (recorder_read(&entries[i & (RECORDER_ENTRIES - 1)], &e) != EXIT_SUCCESS || e.index != i)  // overwritten meanwhile
+            continue;
+        char text[256];
+        size_t len = 0;
+        recorder_format(&e, text, &len, sizeof(text));
+        printf("[%5llu.%06llu] %.*s\r\n", (unsigned long long)(e.time / 1000000000), (unsigned long long)(e.time % 1000000000 / 1000), (int)len,
+               text);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Sends the request over the control socket and waits for the reply of init
+ * 
+ * @param request CONTROL_WAIT_*, CONTROL_FREEZE or CONTROL_THAW
+ * @param timeout seconds, 0 waits forever
+ * @return int EXIT_SUCCESS, EXIT_FAILURE or WAIT_TIMEDOUT
+ */
+static int sendRequest(const char* request, double timeout) {
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, CONTROL_SOCKET, sizeof(addr.sun_path) - 1);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror(CONTROL_SOCKET);
+        return EXIT_FAILURE;
+    }
+    if (send(fd, request, strlen(request), 0) < 0) {
+        perror("send");
+        return EXIT_FAILURE;
+    }
+
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (poll(&pfd, 1, timeout > 0 ? (int)(timeout * 1000) : -1) == 0) {
+        printf("Error: timed out!\r\n");
+        return WAIT_TIMEDOUT;
+    }
+    char reply[CONTROL_MAXMSG];
+    ssize_t len = recv(fd, reply, sizeof(reply) - 1, 0);
+    close(fd);
+    if (len <= 0) {
+        printf("Error: init closed the connection!\r\n");
+        return EXIT_FAILURE;
+    }
+    reply[len] = '\0';
+
+    if (strcmp(reply, CONTROL_OK) == 0)
+        return EXIT_SUCCESS;
+    if (strncmp(reply, CONTROL_FAILED, strlen(CONTROL_FAILED)) == 0)
+        printf("Error: %s!\r\n", reply + strlen(CONTROL_FAILED));
+    else
+        printf("Error: %s!\r\n", reply);
+    return EXIT_FAILURE;
+}
 
 int main(int argc, char** argv) {
     int c;
     opterr = 0;
-    uint8_t optCmdPos = 0;  // option command position
+    int optCmdPos;  // option command position
     int16_t commandSelected = -1;
-    while ((c = getopt(argc, argv, ":")) != -1)
-        ;
+    double timeout = 0;  // of wait, 0 waits forever
+    static const struct option longOptions[] = {{"timeout", required_argument, NULL, 't'}, {NULL, 0, NULL, 0}};
+    while ((c = getopt_long(argc, argv, ":", longOptions, NULL)) != -1) {
+        if (c == 't') {
+            char* end;
+            timeout = strtod(optarg, &end);
+            if (*optarg == '\0' || *end != '\0' || timeout <= 0) {
+                printf("Error: timeout must be a positive number of seconds!\r\n");
+                return EXIT_FAILURE;
+            }
+        } else if (c == ':') {
+            printf("Error: %s needs an argument!\r\n", argv[optind - 1]);
+            return EXIT_FAILURE;
+        }
+    }
 
+    if (optind >= argc) {
+        printf("Error: you must specify a command!\r\n");
+        return EXIT_FAILURE;
+    }
+    optCmdPos = optind;  // getopt moved options before the first non-option, which is the command
     for (uint8_t i = 0; i < sizeof(commandTable) / sizeof(commandTable[0]); i++) {
-        for (int j = optind; j < argc; j++) {
-            if (strcmp(argv[j], commandTable[i].name) == 0) {
-                optCmdPos = j;        // command position in the argv
-                commandSelected = i;  // number of command from the table
-                break;
-            }
+        if (strcmp(argv[optCmdPos], commandTable[i].name) == 0) {
+            commandSelected = i;  // number of command from the table
+            break;
         }
     }
 
     if (commandSelected < 0) {
-        printf("Error: you must specify a command!\r\n");
+        printf("Error: unknown command %s!\r\n", argv[optCmdPos]);
         return EXIT_FAILURE;
     }
 
-    for (int i = optCmdPos + 1; i < (optCmdPos + commandTable[commandSelected].numArgs); i++) {
-        // iterating through needed arguments and setting options
+    if (optCmdPos + commandTable[commandSelected].numArgs >= argc) {
+        printf("Error: %s needs %d argument(s)!\r\n", commandTable[commandSelected].name, commandTable[commandSelected].numArgs);
+        return EXIT_FAILURE;
     }
+    char** cmdArgs = argv + optCmdPos + 1;  // arguments of the command
 
     if (strcmp(commandTable[commandSelected].name, "halt") == 0) {  // if command was halt, then ..
         printf("Halting! \r\n");
@@ -57,6 +298,46 @@ int main(int argc, char** argv) {
         printf("Rebooting! \r\n");
         kill(1, SIGTERM);
         return EXIT_SUCCESS;
+    } else if (strcmp(commandTable[commandSelected].name, "runlevel") == 0) {
+        char* end;
+        long level = strtol(cmdArgs[0], &end, 10);
+        if (*cmdArgs[0] == '\0' || *end != '\0' || level < 0 || level > RUNLEVEL_MAX) {
+            printf("Error: runlevel must be between 0 and %d!\r\n", RUNLEVEL_MAX);
+            return EXIT_FAILURE;
+        }
+        printf("Switching to runlevel %ld! \r\n", level);
+        union sigval value = {.sival_int = (int)level};
+        if (sigqueue(1, SIGNAL_RUNLEVEL, value) < 0) {
+            perror("sigqueue");
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    } else if (strcmp(commandTable[commandSelected].name, "status") == 0) {
+        return printStatus();
+    } else if (strcmp(commandTable[commandSelected].name, "freeze") == 0 || strcmp(commandTable[commandSelected].name, "thaw") == 0) {
+        char request[CONTROL_MAXMSG];
+        const char* prefix = commandTable[commandSelected].name[0] == 'f' ? CONTROL_FREEZE : CONTROL_THAW;
+        if (snprintf(request, sizeof(request), "%s%s", prefix, cmdArgs[0]) >= (int)sizeof(request)) {
+            printf("Error: service name is too long!\r\n");
+            return EXIT_FAILURE;
+        }
+        return sendRequest(request, timeout);
+    } else if (strcmp(commandTable[commandSelected].name, "trace") == 0) {
+        return printTrace();
+    } else if (strcmp(commandTable[commandSelected].name, "wait") == 0) {
+        char request[CONTROL_MAXMSG];
+        if (strcmp(cmdArgs[0], "boot-complete") == 0) {
+            snprintf(request, sizeof(request), CONTROL_WAIT_BOOT);
+        } else if (strcmp(cmdArgs[0], "service") == 0 && optCmdPos + 2 < argc) {
+            if (snprintf(request, sizeof(request), CONTROL_WAIT_SERVICE "%s", cmdArgs[1]) >= (int)sizeof(request)) {
+                printf("Error: service name is too long!\r\n");
+                return EXIT_FAILURE;
+            }
+        } else {
+            printf("Error: wait needs boot-complete or service <name>!\r\n");
+            return EXIT_FAILURE;
+        }
+        return sendRequest(request, timeout);
     }
     return EXIT_FAILURE;
 }
\ No newline at end of file
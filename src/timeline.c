@@ -0,0 +1,116 @@
+/**
+ * @file timeline.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "timeline.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "console.h"
+#include "utilities.h"
+
+/**
+ * @brief Event of the boot, eg. boot phase or start of a service
+ * 
+ */
+struct timeline_entry {
+    char kind[16];
+    char name[TIMELINE_NAMELEN];
+    double start;  // monotonic time, that is seconds since the kernel booted
+    double end;
+    uint8_t has_usage;
+    struct process_usage usage;
+};
+
+static struct timeline_entry entries[TIMELINE_MAXENTRIES];
+static size_t entry_count = 0;
+static uint8_t written = 0;  // events after boot aren't recorded
+
+/**
+ * @brief Records event of the boot
+ * 
+ * @param kind kind of the event eg. phase or service
+ * @param name name of the event
+ * @param start monotonic time when it started
+ * @param end monotonic time when it ended
+ * @param usage resources used, NULL if it isn't a process
+ */
+void timeline_add(const char* kind, const char* name, double start, double end, const struct process_usage* usage) {
+    if (written || entry_count == TIMELINE_MAXENTRIES)
+        return;
+
+    struct timeline_entry* e = &entries[entry_count++];
+    snprintf(e->kind, sizeof(e->kind), "%s", kind);
+    snprintf(e->name, sizeof(e->name), "%s", name);
+    e->start = start;
+    e->end = end;
+    e->has_usage = usage != NULL;
+    if (usage)
+        e->usage = *usage;
+}
+
+/**
+ * @brief Writes recorded events to TIMELINE_FILE, called when boot is finished
+ * 
+ */
+void timeline_write() {
+    written = 1;
+
+    util_dirCreate(RUN_DIR, 0755);
+    FILE* f = fopen(TIMELINE_FILE, "w");
+    if (!f) {
+        console_error("failed writing %s: %s\r\n", TIMELINE_FILE, strerror(errno));
+        return;
+    }
+
+    fprintf(f, "# offset[s] duration[s] kind name user[s] sys[s] maxrss[KB] majflt nvcsw nivcsw\n");
+    for (size_t i = 0; i < entry_count; i++) {
+        const struct timeline_entry* e = &entries[i];
+        fprintf(f, "%.6f %.6f %s %s", e->start, e->end - e->start, e->kind, e->name);
+        if (e->has_usage)
+            fprintf(f, " %.6f %.6f %ld %ld %ld %ld\n", e->usage.user, e->usage.sys, e->usage.maxrss, e->usage.majflt, e->usage.nvcsw, e->usage.nivcsw);
+        else
+            fprintf(f, " - - - - - -\n");
+    }
+    fclose(f);
+}
+
+/**
+ * @brief Saves recorded events to TIMELINE_HANDOFF for init which is executed next, eg. in the real root
+ * 
+ */
+void timeline_handoff() {
+    util_dirCreate(RUN_DIR, 0755);
+    FILE* f = fopen(TIMELINE_HANDOFF, "w");
+    if (!f)
+        return;
+    uint32_t header[2] = {sizeof(struct timeline_entry), entry_count};
+    fwrite(header, sizeof(header), 1, f);
+    fwrite(entries, sizeof(struct timeline_entry), entry_count, f);
+    fclose(f);
+}
+
+/**
+ * @brief Restores events saved by the previous init, called before any event is recorded
+ * 
+ */
+void timeline_restore() {
+    FILE* f = fopen(TIMELINE_HANDOFF, "r");
+    if (!f)
+        return;
+    uint32_t header[2];
+    if (fread(header, sizeof(header), 1, f) == 1 && header[0] == sizeof(struct timeline_entry) && header[1] <= TIMELINE_MAXENTRIES)
+        entry_count = fread(entries, sizeof(struct timeline_entry), header[1], f);
+    fclose(f);
+    unlink(TIMELINE_HANDOFF);
+}
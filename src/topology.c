@@ -0,0 +1,206 @@
+/**
+ * @file topology.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "topology.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "console.h"
+
+/*! \cond PRIVATE */
+#define WORD_BITS (8 * sizeof(unsigned long))
+/*! \endcond */
+
+/**
+ * @brief Adds CPU to the set
+ * 
+ * @param set set
+ * @param cpu number of the CPU, ignored if it doesn't fit
+ */
+static void cpuAdd(struct topology_cpus *set, unsigned long cpu) {
+    if (cpu < TOPOLOGY_MAXCPUS)
+        set->bits[cpu / WORD_BITS] |= 1ul << (cpu % WORD_BITS);
+}
+
+/**
+ * @brief Counts CPUs in the set
+ * 
+ * @param set set
+ * @return uint16_t number of CPUs
+ */
+static uint16_t cpuCount(const struct topology_cpus *set) {
+    uint16_t count = 0;
+    for (size_t i = 0; i < sizeof(set->bits) / sizeof(set->bits[0]); i++)
+        count += __builtin_popcountl(set->bits[i]);
+    return count;
+}
+
+/**
+ * @brief Finds n-th CPU of the set
+ * 
+ * @param set set
+ * @param n index, must be lower than number of CPUs in the set
+ * @return unsigned long number of the CPU
+ */
+static unsigned long cpuNth(const struct topology_cpus *set, uint16_t n) {
+    for (unsigned long cpu = 0; cpu < TOPOLOGY_MAXCPUS; cpu++) {
+        if ((set->bits[cpu / WORD_BITS] & (1ul << (cpu % WORD_BITS))) && n-- == 0)
+            return cpu;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads CPUs on which init may run, children inherit them
+ * 
+ * @param out set
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t allowedCpus(struct topology_cpus *out) {
+    memset(out, 0, sizeof(*out));
+    if (syscall(SYS_sched_getaffinity, 0, sizeof(out->bits), out->bits) < 0)
+        return EXIT_FAILURE;
+    return cpuCount(out) > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Reads list of CPUs or nodes from sysfs, eg. 0-3,8-11
+ * 
+ * @param path path of the file
+ * @param out set, nodes use the same numbering as CPUs
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t readList(const char *path, struct topology_cpus *out) {
+    char buf[4096];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return EXIT_FAILURE;
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len < 0)
+        return EXIT_FAILURE;
+    buf[len] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+
+    memset(out, 0, sizeof(*out));
+    const char *p = buf;
+    while (*p != '\0') {
+        char *end;
+        unsigned long first = strtoul(p, &end, 10);
+        unsigned long last = first;
+        if (end == p)
+            return EXIT_FAILURE;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtoul(p, &end, 10);
+            if (end == p || last < first)
+                return EXIT_FAILURE;
+        }
+        for (unsigned long cpu = first; cpu <= last && cpu < TOPOLOGY_MAXCPUS; cpu++)
+            cpuAdd(out, cpu);
+
+        p = end;
+        if (*p == ',')
+            p++;
+        else if (*p != '\0')
+            return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Reads CPUs of the NUMA node which init may run on
+ * 
+ * @param node number of the node
+ * @param allowed CPUs on which init may run
+ * @param out set
+ * @return uint16_t number of CPUs in the set, 0 if the node has none
+ */
+static uint16_t nodeCpus(unsigned long node, const struct topology_cpus *allowed, struct topology_cpus *out) {
+    char path[sizeof(TOPOLOGY_NODE_DIR) + 32];
+    snprintf(path, sizeof(path), TOPOLOGY_NODE_DIR "/node%lu/cpulist", node);
+    if (readList(path, out) != EXIT_SUCCESS)
+        return 0;
+    for (size_t i = 0; i < sizeof(out->bits) / sizeof(out->bits[0]); i++)
+        out->bits[i] &= allowed->bits[i];
+    return cpuCount(out);
+}
+
+/**
+ * @brief Returns number of CPUs on which init may run, as limited by its affinity or cpuset
+ * 
+ * @return uint16_t number of CPUs, at least 1
+ */
+uint16_t topology_cpuCount() {
+    struct topology_cpus allowed;
+    if (allowedCpus(&allowed) != EXIT_SUCCESS)
+        return 1;
+    return cpuCount(&allowed);
+}
+
+/**
+ * @brief Chooses CPUs for the index, consecutive indexes get different CPUs or nodes
+ * and wrap around when there are more indexes than CPUs or nodes
+ * @param kind TOPOLOGY_CPU or TOPOLOGY_NUMA
+ * @param index eg. number of the instance
+ * @param out set with one CPU or all CPUs of one node
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t topology_cpuSet(uint8_t kind, uint16_t index, struct topology_cpus *out) {
+    struct topology_cpus allowed;
+    if (allowedCpus(&allowed) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    if (kind == TOPOLOGY_CPU) {
+        memset(out, 0, sizeof(*out));
+        cpuAdd(out, cpuNth(&allowed, index % cpuCount(&allowed)));
+        return EXIT_SUCCESS;
+    }
+    if (kind != TOPOLOGY_NUMA)
+        return EXIT_FAILURE;
+
+    struct topology_cpus nodes;
+    if (readList(TOPOLOGY_NODE_DIR "/online", &nodes) != EXIT_SUCCESS) {
+        *out = allowed;  // kernel without NUMA, everything is one node
+        return EXIT_SUCCESS;
+    }
+
+    uint16_t usable = 0;  // nodes with CPUs, memory-only nodes are skipped
+    for (uint16_t i = 0; i < cpuCount(&nodes); i++) {
+        if (nodeCpus(cpuNth(&nodes, i), &allowed, out) > 0)
+            usable++;
+    }
+    if (usable == 0) {
+        *out = allowed;
+        return EXIT_SUCCESS;
+    }
+
+    uint16_t target = index % usable;
+    for (uint16_t i = 0; i < cpuCount(&nodes); i++) {
+        if (nodeCpus(cpuNth(&nodes, i), &allowed, out) > 0 && target-- == 0)
+            return EXIT_SUCCESS;
+    }
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief Pins the calling process to the CPUs, runs in the child before exec
+ * 
+ * @param cpus set
+ */
+void topology_apply(const struct topology_cpus *cpus) {
+    if (syscall(SYS_sched_setaffinity, 0, sizeof(cpus->bits), cpus->bits) < 0)
+        console_error("failed setting CPU affinity: %s\r\n", strerror(errno));
+}
@@ -0,0 +1,64 @@
+/**
+ * @file trace.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "console.h"
+#include "utilities.h"
+
+int trace_fd = -1;
+
+/**
+ * @brief Opens trace_marker when it's enabled, mounts tracefs if needed
+ * 
+ */
+void trace_init() {
+    char buf[8];
+    uint8_t enabled = TRACE_MARKER;
+    if (util_cmdlineGet("quickinit.trace", buf, sizeof(buf)) == EXIT_SUCCESS)
+        enabled = strcmp(buf, "0") != 0;  // quickinit.trace without value enables it
+    if (!enabled)
+        return;
+
+    trace_fd = open(TRACE_MARKER_FILE, O_WRONLY | O_CLOEXEC);
+    if (trace_fd < 0 && errno == ENOENT && mount("nodev", TRACE_TRACEFS, "tracefs", 0, NULL) == 0)
+        trace_fd = open(TRACE_MARKER_FILE, O_WRONLY | O_CLOEXEC);
+    if (trace_fd < 0)
+        console_error("failed opening %s: %s\r\n", TRACE_MARKER_FILE, strerror(errno));
+}
+
+/**
+ * @brief Writes event to trace_marker, use TRACE instead
+ * 
+ * @param fmt printf format
+ * @param ... arguments
+ */
+void trace_write(const char *fmt, ...) {
+    char buf[TRACE_MAXLEN];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len < 0)
+        return;
+    if ((size_t)len >= sizeof(buf))
+        len = sizeof(buf) - 1;
+    if (write(trace_fd, buf, len) < 0 && errno == EBADF)
+        trace_fd = -1;
+}
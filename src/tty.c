@@ -10,226 +10,531 @@
 #include "tty.h"
 
 #include <errno.h>
-#include <pthread.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <glob.h>
+#include <limits.h>
+#include <linux/netlink.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <termios.h>
 #include <time.h>
+#include <unistd.h>
 
+#include "arena.h"
 #include "config.h"
 #include "console.h"
+#include "loop.h"
+#include "metrics.h"
 #include "process.h"
+#include "runlevel.h"
+#include "status.h"
+#include "trace.h"
+#include "ttyconf.h"
 
-static uint8_t tty_count = 0;
+static struct tty_config conf = {{NULL, 0, 0}, {NULL, 0, 0}, {NULL}};  // entries from config file and hotplugged devices
 
-struct tty_struct tty_data[TTY_MAXTTYS];
+static void ttyExited(void *owner, const struct process_exit *ex);
 
 /**
- * @brief Start a tty
- * Function starts tty using a tty id.
+ * @brief Frees hotplugged tty entry
  * 
- * @param tty id of tty
- * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ * @param t tty
  */
-uint8_t tty_start(uint8_t tty) {
-    if (tty > tty_count)  // if tty is bigger than tty set up
-        return EXIT_FAILURE;
+static void freeTty(struct tty_struct *t) {
+    struct arena arena = t->arena;  // the entry lives in its own arena
+    arena_free(&arena);
+}
 
-    if (tty_data[tty].state == TTY_STATE_RUNNING)
-        return EXIT_FAILURE;
+/**
+ * @brief Publishes tty in the status page
+ * 
+ * @param t tty
+ */
+static void publishTty(const struct tty_struct *t) {
+    status_set(t->status_slot, t->state, t->pid, t->pid ? t->time : 0, t->exit_code, t->exit_signal, t->restarts);
+}
 
-    if (tty_data[tty].pid != 0) {
-        if (difftime(time(NULL), tty_data[tty].time) < TTY_STARTINTERVAL)  // prevent spamming
+/**
+ * @brief Spawns the process of a tty
+ * 
+ * @param t tty
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE if it was started too recently or fork failed
+ */
+static uint8_t spawnTty(struct tty_struct *t) {
+    if (t->time != 0) {
+        if (difftime(time(NULL), t->time) < TTY_STARTINTERVAL) {  // prevent spamming
+            metrics_inc(METRICS_BACKOFFS);
             return EXIT_FAILURE;
+        }
+    }
+
+    t->time = time(NULL);  // set time to current
+
+    if (t->is_tty)
+        console_clearTty(t->dev);
+    t->pid = process_spawn(&t->plan);
+    if (t->pid < 0) {  // respawn entries are retried by the tick
+        t->pid = 0;
+        publishTty(t);
+        return EXIT_FAILURE;
     }
+    process_watch(t->pid, ttyExited, t);
+    publishTty(t);
+
+    console_debug("started %s with PID=%d\r\n", t->dev, t->pid);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Closes askfirst tty held by init
+ * 
+ * @param t tty
+ */
+static void closeAskfirst(struct tty_struct *t) {
+    if (t->ask_fd < 0)
+        return;
+    loop_removeFd(t->ask_fd);
+    close(t->ask_fd);
+    t->ask_fd = -1;
+}
 
-    tty_data[tty].time = time(NULL);  // set time to current
+static uint8_t askFirst(struct tty_struct *t);
 
-    if (tty_data[tty].is_tty) {
-        console_clearTty(tty_data[tty].dev);
-        tty_data[tty].pid = process_executeTty(tty_data[tty].command, tty);
+/**
+ * @brief Input on askfirst tty, spawns the process when Enter is pressed
+ * 
+ * @param fd descriptor of the tty
+ * @param events epoll events
+ * @param data pointer to tty_struct
+ */
+static void askfirstInput(int fd, uint32_t events, void *data) {
+    struct tty_struct *t = (struct tty_struct *)data;
+    uint8_t enter = 0;
+    char buf[64];
+    ssize_t n;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        if (memchr(buf, '\n', n) || memchr(buf, '\r', n))
+            enter = 1;
+    }
+    uint8_t hangup = n == 0 || (n < 0 && errno != EAGAIN) || (events & (EPOLLHUP | EPOLLERR));
+    if (!enter && !hangup)
+        return;
+
+    tcflush(fd, TCIFLUSH);  // don't pass the Enter to the process
+    closeAskfirst(t);
+    t->state = TTY_STATE_STOPPED;
+    if (!enter) {
+        console_error("%s hung up\r\n", t->dev);
+        publishTty(t);
+        return;
+    }
+
+    if (spawnTty(t) == EXIT_SUCCESS) {
+        t->state = TTY_STATE_RUNNING;
+        publishTty(t);
     } else {
-        tty_data[tty].pid = process_execute(tty_data[tty].command);
+        askFirst(t);  // activated too quickly after the last run, ask again
+    }
+}
+
+/**
+ * @brief Prints the prompt on askfirst tty and waits for Enter in the event loop
+ * No process is forked until the console is activated.
+ * @param t tty
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t askFirst(struct tty_struct *t) {
+    console_clearTty(t->dev);
+    int fd = open(t->dev, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        console_error("failed opening %s: %s\r\n", t->dev, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (write(fd, TTY_ASKFIRST_PROMPT, strlen(TTY_ASKFIRST_PROMPT)) < 0 || loop_addFd(fd, EPOLLIN, askfirstInput, t) != EXIT_SUCCESS) {
+        close(fd);
+        return EXIT_FAILURE;
     }
 
-    tty_data[tty].state = TTY_STATE_RUNNING;
-    console_debug("started %s with PID=%d\r\n", tty_data[tty].dev, tty_data[tty].pid);
+    t->ask_fd = fd;
+    t->state = TTY_STATE_WAITING;
+    publishTty(t);
     return EXIT_SUCCESS;
 }
 
 /**
- * @brief Stop a tty
- * Function stops tty using a tty id.
+ * @brief Starts tty entry
  * 
- * @param tty id of tty
+ * @param t tty
  * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
  */
-uint8_t tty_stop(uint8_t tty) {
-    if (tty > tty_count)
+static uint8_t startTty(struct tty_struct *t) {
+    if (t->state != TTY_STATE_STOPPED)
         return EXIT_FAILURE;
 
-    if (tty_data[tty].state != TTY_STATE_RUNNING)
+    if (t->is_tty && t->action == TTY_ACTION_ASKFIRST)
+        return askFirst(t);
+
+    if (spawnTty(t) != EXIT_SUCCESS)
         return EXIT_FAILURE;
 
-    kill(tty_data[tty].pid, SIGTERM);
-    kill(tty_data[tty].pid, SIGKILL);
-    tty_data[tty].pid = 0;
-    tty_data[tty].state = TTY_STATE_STOPPED;
-    console_debug("stopped %s with PID=%d\r\n", tty_data[tty].dev, tty_data[tty].pid);
+    t->state = TTY_STATE_RUNNING;
+    publishTty(t);
     return EXIT_SUCCESS;
 }
 
 /**
- * @brief Respawn a tty
- * Function respawns tty using a tty id.
+ * @brief Stops tty entry
  * 
- * @param tty id of tty
+ * @param t tty
  * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
  */
-uint8_t tty_respawn(uint8_t tty) {
-    if (tty > tty_count)
+static uint8_t stopTty(struct tty_struct *t) {
+    if (t->state == TTY_STATE_WAITING) {
+        closeAskfirst(t);
+        t->state = TTY_STATE_STOPPED;
+        publishTty(t);
+        return EXIT_SUCCESS;
+    }
+
+    if (t->state != TTY_STATE_RUNNING)
         return EXIT_FAILURE;
 
-    if (getpgid(tty_data[tty].pid) <= 0) {  // check if tty is running or it's killed
-        if (tty_data[tty].action == TTY_ACTION_RESPAWN) {
-            if (tty_data[tty].state == TTY_STATE_RUNNING) {  // if it isn't running but it should - restart it
-                console_debug("respawning %s\r\n", tty_data[tty].dev);
-                tty_stop(tty);
-                tty_start(tty);
-            }
-        }
+    if (t->pid != 0) {
+        process_unwatch(t->pid);  // it is reaped silently
+        kill(t->pid, SIGTERM);
+        kill(t->pid, SIGKILL);
     }
-
+    console_debug("stopped %s with PID=%d\r\n", t->dev, t->pid);
+    t->pid = 0;
+    t->state = TTY_STATE_STOPPED;
+    publishTty(t);
     return EXIT_SUCCESS;
 }
 
 /**
- * @brief TTY respawn thread function
+ * @brief Respawns tty entry if its process has exited and it should be running
  * 
+ * @param t tty
  */
-static void *tty_thread() {
-    console_debug("tty watchdog started\r\n");
-    while (1) {
-        for (uint8_t i = 0; i < tty_count; i++) {
-            if (tty_respawn(i) == EXIT_FAILURE) {
-                console_error("error occured while respawning tty!\r\n");
+static void respawnTty(struct tty_struct *t) {
+    if (t->pid == 0) {  // process has exited
+        if (t->action == TTY_ACTION_RESPAWN) {
+            if (t->state == TTY_STATE_RUNNING) {  // if it isn't running but it should - restart it
+                console_debug("respawning %s\r\n", t->dev);
+                if (spawnTty(t) == EXIT_SUCCESS) {  // if started too recently, next tick retries
+                    TRACE(respawn_tty, t->dev, t->pid);
+                    t->restarts++;
+                    publishTty(t);
+                    metrics_inc(METRICS_TTY_RESPAWNS);
+                }
             }
-            sleep(1);
         }
     }
-    return NULL;
 }
 
 /**
- * @brief Read and parse tty configfile
- * File format:
- * /dev/tty[xyz]:[runlevel]:[respawn askfirst once]:[command]
+ * @brief Start a tty
+ * Function starts tty using a tty id.
+ * 
+ * @param tty id of tty
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t tty_start(size_t tty) {
+    if (tty >= conf.ttys.count)  // if tty is bigger than tty set up
+        return EXIT_FAILURE;
+
+    return startTty(conf.ttys.items[tty]);
+}
+
+/**
+ * @brief Stop a tty
+ * Function stops tty using a tty id.
+ * 
+ * @param tty id of tty
  * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
  */
-static uint8_t readTtyFile() {
-    FILE *fp;
-    fp = fopen("/etc/quickinit/tty", "r");
-    if (fp == NULL) {
-        console_error("tty configuration not found!\r\n");
+uint8_t tty_stop(size_t tty) {
+    if (tty >= conf.ttys.count)
         return EXIT_FAILURE;
+
+    return stopTty(conf.ttys.items[tty]);
+}
+
+/**
+ * @brief Respawn a tty
+ * Function respawns tty using a tty id.
+ * 
+ * @param tty id of tty
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t tty_respawn(size_t tty) {
+    if (tty >= conf.ttys.count)
+        return EXIT_FAILURE;
+
+    respawnTty(conf.ttys.items[tty]);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Called by the reaper when process of a tty exits
+ * 
+ * @param owner pointer to tty_struct
+ * @param ex exit information
+ */
+static void ttyExited(void *owner, const struct process_exit *ex) {
+    struct tty_struct *t = (struct tty_struct *)owner;
+
+    console_debug("%s exited, code=%d signal=%d\r\n", t->dev, ex->code, ex->signal);
+    t->pid = 0;
+    t->exit_code = ex->code;
+    t->exit_signal = ex->signal;
+    if (t->action != TTY_ACTION_RESPAWN)
+        t->state = TTY_STATE_STOPPED;
+    publishTty(t);
+
+    respawnTty(t);  // only respawn entries are restarted
+}
+
+/**
+ * @brief Retries respawning of ttys which were started too recently
+ * 
+ */
+static void ttyTick() {
+    for (size_t i = 0; i < conf.ttys.count; i++)
+        respawnTty(conf.ttys.items[i]);
+}
+
+/**
+ * @brief Creates entry for a device matching pattern entry
+ * Every TTY_PATTERN_VAR in the command is replaced with the device name.
+ * @param pattern pattern entry
+ * @param name device name without /dev/ eg. ttyUSB0
+ * @return struct tty_struct* new entry or NULL
+ */
+static struct tty_struct *instantiatePattern(const struct tty_struct *pattern, const char *name) {
+    struct arena arena;
+    arena_init(&arena);
+
+    struct tty_struct *t = (struct tty_struct *)arena_alloc(&arena, sizeof(struct tty_struct));
+    if (!t) {
+        arena_free(&arena);
+        return NULL;
     }
 
-    char *file_buf = (char *)malloc((TTY_MAX_LINELEN + 1) * sizeof(char));
-
-    uint8_t i = 0;
-    while (fgets(file_buf, TTY_MAX_LINELEN, fp) != NULL) {
-        if (strncmp(file_buf, "#", 1) != 0 && strncmp(file_buf, "//", 2) != 0) {  // ignore lines beggining with ; or // or #
-            uint8_t field = 0;                                                    //current field in line
-            uint8_t error = 0;                                                    // error in current line
-            struct tty_struct tty_buf;
-            tty_buf.state = TTY_STATE_STOPPED;
-            tty_buf.time = 0;
-
-            strtok(file_buf, "\n");  // strange way to remove newline
-
-            char *ttystr;
-            char *strsep_buf = strdup(file_buf);
-            while ((ttystr = strsep(&strsep_buf, ":")) != NULL) {
-                switch (field) {
-                    case 0:                                   // device
-                        if (strstr(ttystr, "tty") != NULL) {  //, add /dev before
-                            char ttydev[64];
-                            snprintf(ttydev, 64, "/dev/%s", ttystr);
-                            strcpy(tty_buf.dev, ttydev);
-                            tty_buf.is_tty = 1;
-                        } else {
-                            tty_buf.is_tty = 0;
-                        }
-                        break;
-                    case 1:  // runlevel
-                             /* runlevels are not supported */
-                        break;
-                    case 2:  // action
-                        if (strstr(ttystr, "askfirst") != NULL) {
-                            tty_buf.action = TTY_ACTION_ASKFIRST;
-                        } else if (strstr(ttystr, "once") != NULL) {
-                            tty_buf.action = TTY_ACTION_ONCE;
-                        } else if (strstr(ttystr, "respawn") != NULL) {
-                            tty_buf.action = TTY_ACTION_RESPAWN;
-                        } else {
-                            error = 1;
-                        }
-                        break;
-                    case 3:  // command
-                        strcpy(tty_buf.command, ttystr);
-                        break;
-                }
-                field++;
+    *t = *pattern;
+    t->hotplug = 1;
 
-                if (error > 0)
-                    break;
-            }
+    size_t varlen = strlen(TTY_PATTERN_VAR);
+    size_t count = 0;
+    for (const char *p = strstr(pattern->command, TTY_PATTERN_VAR); p != NULL; p = strstr(p + varlen, TTY_PATTERN_VAR))
+        count++;
 
-            if (field > 2) {  // there were all fields in the line
-                tty_data[i] = tty_buf;
-                i++;
-            }
-        }
+    t->dev = (char *)arena_alloc(&arena, strlen("/dev/") + strlen(name) + 1);
+    t->command = (char *)arena_alloc(&arena, strlen(pattern->command) + count * strlen(name) + 1);
+    if (!t->dev || !t->command) {
+        arena_free(&arena);
+        return NULL;
     }
+    sprintf(t->dev, "/dev/%s", name);
 
-    tty_count = i;
-    free(file_buf);
+    char *out = t->command;
+    const char *in = pattern->command;
+    for (const char *p; (p = strstr(in, TTY_PATTERN_VAR)) != NULL; in = p + varlen) {
+        memcpy(out, in, p - in);
+        out = stpcpy(out + (p - in), name);
+    }
+    strcpy(out, in);
 
-    if (fclose(fp) != 0)
-        return EXIT_FAILURE;
+    if (process_buildPlan(&arena, &t->plan, t->command, t->dev) != EXIT_SUCCESS) {
+        arena_free(&arena);
+        return NULL;
+    }
+    t->arena = arena;
+    return t;
+}
 
-    return EXIT_SUCCESS;
+/**
+ * @brief Searches for entry by device path
+ * 
+ * @param dev path eg. /dev/ttyUSB0
+ * @return size_t id of tty, conf.ttys.count if not found
+ */
+static size_t findTty(const char *dev) {
+    size_t i = 0;
+    while (i < conf.ttys.count && strcmp(conf.ttys.items[i]->dev, dev) != 0)
+        i++;
+    return i;
+}
+
+/**
+ * @brief Device appeared, creates and starts entry for the first matching pattern
+ * 
+ * @param name device name without /dev/ eg. ttyUSB0
+ */
+static void deviceAdded(const char *name) {
+    char dev[PATH_MAX];
+    snprintf(dev, sizeof(dev), "/dev/%s", name);
+    if (findTty(dev) < conf.ttys.count)
+        return;  // already has an entry
+
+    for (size_t i = 0; i < conf.patterns.count; i++) {
+        if (fnmatch(conf.patterns.items[i]->dev, dev, FNM_PATHNAME) != 0)
+            continue;
+
+        struct tty_struct *t = instantiatePattern(conf.patterns.items[i], name);
+        if (!t || ttyconf_append(&conf.ttys, t) != EXIT_SUCCESS) {
+            console_error("no memory for %s\r\n", dev);
+            if (t)
+                freeTty(t);
+            return;
+        }
+        console_debug("%s appeared\r\n", dev);
+        t->status_slot = status_slot(STATUS_KIND_TTY, t->dev);
+        publishTty(t);
+        if (RUNLEVEL_IN(t->runlevels, runlevel_current()))
+            startTty(t);
+        return;
+    }
 }
 
 /**
- * @brief Creates new thread which keeps respawning ttys
+ * @brief Device disappeared, stops and removes its hotplugged entry
  * 
+ * @param name device name without /dev/ eg. ttyUSB0
  */
-static void watchdog() {
-    pthread_t watchdog_thread;
+static void deviceRemoved(const char *name) {
+    char dev[PATH_MAX];
+    snprintf(dev, sizeof(dev), "/dev/%s", name);
+
+    size_t i = findTty(dev);
+    if (i == conf.ttys.count || !conf.ttys.items[i]->hotplug)
+        return;
+
+    console_debug("%s disappeared\r\n", dev);
+    stopTty(conf.ttys.items[i]);
+    status_release(conf.ttys.items[i]->status_slot);
+    freeTty(conf.ttys.items[i]);
+    conf.ttys.items[i] = conf.ttys.items[--conf.ttys.count];  // order of entries doesn't matter
+}
+
+/**
+ * @brief Reads kobject uevents, tty devices are added and removed
+ * Message format: action@devpath\0KEY=value\0KEY=value\0...
+ * @param fd netlink socket
+ * @param events epoll events
+ * @param data unused
+ */
+static void readUevents(int fd, uint32_t events, void *data) {
+    char buf[TTY_UEVENT_BUFSIZE];
+    ssize_t len;
+
+    while ((len = recv(fd, buf, sizeof(buf) - 1, 0)) > 0) {
+        buf[len] = '\0';
+        const char *action = NULL;
+        const char *subsystem = NULL;
+        const char *devname = NULL;
+
+        for (char *p = buf + strlen(buf) + 1; p < buf + len; p += strlen(p) + 1) {
+            if (strncmp(p, "ACTION=", 7) == 0)
+                action = p + 7;
+            else if (strncmp(p, "SUBSYSTEM=", 10) == 0)
+                subsystem = p + 10;
+            else if (strncmp(p, "DEVNAME=", 8) == 0)
+                devname = p + 8;
+        }
+        if (!action || !subsystem || !devname || strcmp(subsystem, "tty") != 0)
+            continue;
 
-    if (pthread_create(&watchdog_thread, NULL, tty_thread, NULL)) {
-        console_error("error creating thread\r\n");
+        if (strcmp(action, "add") == 0)
+            deviceAdded(devname);
+        else if (strcmp(action, "remove") == 0)
+            deviceRemoved(devname);
     }
 }
 
+/**
+ * @brief Listens for kobject uevents and adds devices which are already present
+ * Does nothing if there are no pattern entries.
+ */
+static void watchHotplug() {
+    if (conf.patterns.count == 0)
+        return;
+
+    struct sockaddr_nl addr = {0};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1;  // kernel uevents
+
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || loop_addFd(fd, EPOLLIN, readUevents, NULL) != EXIT_SUCCESS) {
+        console_error("tty hotplug unavailable: %s\r\n", strerror(errno));
+        if (fd >= 0)
+            close(fd);
+    }
+
+    for (size_t i = 0; i < conf.patterns.count; i++) {  // devices plugged in before boot
+        glob_t found;
+        if (glob(conf.patterns.items[i]->dev, 0, NULL, &found) == 0) {
+            for (size_t j = 0; j < found.gl_pathc; j++)
+                deviceAdded(found.gl_pathv[j] + strlen("/dev/"));
+            globfree(&found);
+        }
+    }
+}
+
+/**
+ * @brief Read and parse tty configfile
+ * Doesn't spawn anything, so it can be used outside of init.
+ * @param path path to the file eg. TTY_CONFIG
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t tty_load(const char *path) {
+    return ttyconf_load(path, &conf);
+}
+
 /**
  * @brief Initializes tty system
  * 
  * 
  */
 void tty_init() {
-    readTtyFile();
-
-    for (uint8_t i = 0; i < tty_count; i++) {
-        tty_data[i].pid = 0;  // set pid to 0 as it isn't running
-        tty_start(i);
+    tty_load(TTY_CONFIG);
+
+    uint8_t level = runlevel_current();
+    for (size_t i = 0; i < conf.ttys.count; i++) {
+        conf.ttys.items[i]->pid = 0;  // set pid to 0 as it isn't running
+        conf.ttys.items[i]->status_slot = status_slot(STATUS_KIND_TTY, conf.ttys.items[i]->dev);
+        publishTty(conf.ttys.items[i]);
+        if (RUNLEVEL_IN(conf.ttys.items[i]->runlevels, level))
+            startTty(conf.ttys.items[i]);
     }
 
-    watchdog();
+    watchHotplug();
+    loop_addTick(ttyTick);
+}
+
+/**
+ * @brief Stops ttys which aren't in the new runlevel and starts those which weren't in the old one
+ * 
+ * @param old previous runlevel
+ * @param new new runlevel
+ */
+void tty_switchRunlevel(uint8_t old, uint8_t new) {
+    for (size_t i = 0; i < conf.ttys.count; i++) {
+        uint8_t was = RUNLEVEL_IN(conf.ttys.items[i]->runlevels, old);
+        uint8_t will = RUNLEVEL_IN(conf.ttys.items[i]->runlevels, new);
+        if (was && !will)
+            stopTty(conf.ttys.items[i]);
+        else if (!was && will)
+            startTty(conf.ttys.items[i]);
+    }
 }
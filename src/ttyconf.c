@@ -0,0 +1,225 @@
+/**
+ * @file ttyconf.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief 
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "ttyconf.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "console.h"
+#include "process.h"
+#include "runlevel.h"
+
+/**
+ * @brief Appends entry to the table, capacity is doubled when it's full
+ * 
+ * @param table table
+ * @param t entry
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t ttyconf_append(struct tty_table *table, struct tty_struct *t) {
+    if (table->count == table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : TTY_TABLE_MINSIZE;
+        struct tty_struct **items = (struct tty_struct **)realloc(table->items, capacity * sizeof(struct tty_struct *));
+        if (!items)
+            return EXIT_FAILURE;
+        table->items = items;
+        table->capacity = capacity;
+    }
+    table->items[table->count++] = t;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Splits field of the line in place
+ * 
+ * @param cursor start of the field, moved after the separator
+ * @param eol end of the line
+ * @param last 1 if the field is the rest of the line
+ * @return char* field or NULL if the line ended before it
+ */
+static char *nextField(char **cursor, const char *eol, uint8_t last) {
+    char *field = *cursor;
+    if (!field)
+        return NULL;
+    char *sep = last ? NULL : (char *)memchr(field, ':', eol - field);
+    if (sep) {
+        *sep = '\0';
+        *cursor = sep + 1;
+    } else {
+        *cursor = NULL;
+    }
+    return field;
+}
+
+/**
+ * @brief Parses one line of tty configfile and adds the entry to the table
+ * Strings of the entry point into the line, which must live as long as the entry.
+ * @param conf configuration to which the entry is added
+ * @param line line without newline
+ * @param eol terminating NUL of the line
+ * @param path path to the file, for errors
+ * @param lineno number of the line, for errors
+ */
+static void parseTtyLine(struct tty_config *conf, char *line, const char *eol, const char *path, unsigned int lineno) {
+    struct tty_struct tty_buf = {0};
+    tty_buf.state = TTY_STATE_STOPPED;
+    tty_buf.time = 0;
+    tty_buf.runlevels = RUNLEVEL_ALL;
+    tty_buf.ask_fd = -1;
+    tty_buf.status_slot = -1;
+
+    char *cursor = line;
+    char *dev = nextField(&cursor, eol, 0);
+    char *runlevels = nextField(&cursor, eol, 0);
+    char *action = nextField(&cursor, eol, 0);
+    char *command = nextField(&cursor, eol, 1);  // command is the rest of the line and can contain ':'
+
+    if (!command) {
+        console_error("%s:%u:%u: expected device:runlevels:action:command\r\n", path, lineno, (unsigned int)(eol - line) + 1);
+        return;
+    }
+    if (*dev == '\0') {
+        console_error("%s:%u:1: missing device\r\n", path, lineno);
+        return;
+    }
+    if (runlevel_parse(runlevels, &tty_buf.runlevels) != EXIT_SUCCESS) {
+        console_error("%s:%u:%u: invalid runlevels %s\r\n", path, lineno, (unsigned int)(runlevels - line) + 1, runlevels);
+        return;
+    }
+    if (strcmp(action, "askfirst") == 0) {
+        tty_buf.action = TTY_ACTION_ASKFIRST;
+    } else if (strcmp(action, "once") == 0) {
+        tty_buf.action = TTY_ACTION_ONCE;
+    } else if (strcmp(action, "respawn") == 0) {
+        tty_buf.action = TTY_ACTION_RESPAWN;
+    } else {
+        console_error("%s:%u:%u: unknown action %s\r\n", path, lineno, (unsigned int)(action - line) + 1, action);
+        return;
+    }
+
+    if (strstr(dev, "tty") != NULL) {  // add /dev before
+        tty_buf.dev = (char *)arena_alloc(&conf->arena, strlen("/dev/") + strlen(dev) + 1);
+        if (tty_buf.dev)
+            sprintf(tty_buf.dev, "/dev/%s", dev);
+        tty_buf.is_tty = 1;
+    } else {
+        tty_buf.dev = dev;
+        tty_buf.is_tty = 0;
+    }
+    tty_buf.command = command;
+
+    uint8_t is_pattern = tty_buf.is_tty && strpbrk(dev, "*?[") != NULL;
+    if (!is_pattern && process_buildPlan(&conf->arena, &tty_buf.plan, command, tty_buf.is_tty ? tty_buf.dev : NULL) != EXIT_SUCCESS) {
+        console_error("%s:%u:%u: invalid command\r\n", path, lineno, (unsigned int)(command - line) + 1);
+        return;
+    }
+
+    struct tty_struct *t = (struct tty_struct *)arena_alloc(&conf->arena, sizeof(struct tty_struct));
+    if (!tty_buf.dev || !t || ttyconf_append(is_pattern ? &conf->patterns : &conf->ttys, t) != EXIT_SUCCESS) {
+        console_error("%s:%u: no memory\r\n", path, lineno);
+        return;
+    }
+    *t = tty_buf;
+}
+
+/**
+ * @brief Read and parse tty configfile
+ * File format:
+ * /dev/tty[xyz]:[runlevel]:[respawn askfirst once]:[command]
+ * Device can be a pattern eg. ttyUSB*, then an entry is created for every matching device.
+ * The file is mapped privately and parsed in one pass, strings of entries point into the mapping,
+ * which is kept in the configuration until ttyconf_free. It can be loaded once per configuration.
+ * @param path path to the file eg. TTY_CONFIG
+ * @param conf configuration to which the entries are added
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+uint8_t ttyconf_load(const char *path, struct tty_config *conf) {
+    if (conf->map) {
+        console_error("%s: tty configuration is already loaded\r\n", path);
+        return EXIT_FAILURE;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        console_error("tty configuration not found!\r\n");
+        return EXIT_FAILURE;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return EXIT_SUCCESS;
+    }
+
+    // private writable mapping, fields are terminated in place and the file isn't changed
+    char *map = (char *)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        console_error("failed mapping %s: %s\r\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    conf->map = map;
+    conf->map_size = st.st_size;
+
+    char *end = map + st.st_size;
+    unsigned int lineno = 0;
+    for (char *line = map; line < end;) {
+        lineno++;
+        char *eol = (char *)memchr(line, '\n', end - line);
+        char *next = eol ? eol + 1 : end;
+        if (eol) {
+            *eol = '\0';
+        } else {  // last line without newline, there may be no room for the terminator in the mapping
+            size_t len = end - line;
+            char *copy = (char *)arena_alloc(&conf->arena, len + 1);
+            if (!copy)
+                break;
+            memcpy(copy, line, len);
+            copy[len] = '\0';
+            eol = copy + len;
+            line = copy;
+        }
+        if (eol > line && eol[-1] == '\r')
+            *--eol = '\0';
+
+        if (*line != '\0' && *line != '#' && strncmp(line, "//", 2) != 0)  // ignore empty lines and lines beggining with // or #
+            parseTtyLine(conf, line, eol, path, lineno);
+        line = next;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Frees entries loaded from the file and unmaps it, hotplugged entries must be freed before
+ * 
+ * @param conf configuration
+ */
+void ttyconf_free(struct tty_config *conf) {
+    if (conf->map)
+        munmap(conf->map, conf->map_size);
+    conf->map = NULL;
+    conf->map_size = 0;
+    arena_free(&conf->arena);
+    free(conf->ttys.items);
+    free(conf->patterns.items);
+    conf->ttys = (struct tty_table){NULL, 0, 0};
+    conf->patterns = (struct tty_table){NULL, 0, 0};
+}
@@ -16,6 +16,7 @@
 #include <string.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
+#include <time.h>
 
 #include "console.h"
 
@@ -62,7 +63,7 @@ static uint8_t doMountMntryExist(char *mntfile, char *dirpath) {
     uint8_t mounted = 0;
     FILE *fp;
 
-    fp = setmntent("", "r");
+    fp = setmntent(mntfile, "r");
     if (!fp)
         return 0;
 
@@ -98,3 +99,57 @@ uint8_t util_isInFstab(char *dirpath) {
     }
     return 0;
 }
+
+/**
+ * @brief Returns monotonic time, used for measuring durations
+ * 
+ * @return double seconds since an unspecified point
+ */
+double util_monotonicTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief FNV-1a hash of a name, eg. of a service
+ * 
+ * @param name name
+ * @return uint32_t hash
+ */
+uint32_t util_hashName(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (; *name != '\0'; name++)
+        hash = (hash ^ (uint8_t)*name) * 16777619u;
+    return hash;
+}
+
+/**
+ * @brief Reads value of key=value parameter from kernel cmdline
+ * 
+ * @param key name of the parameter
+ * @param buf output buffer, empty string if the parameter has no value
+ * @param size size of the buffer
+ * @return uint8_t EXIT_SUCCESS if found, otherwise EXIT_FAILURE
+ */
+uint8_t util_cmdlineGet(const char *key, char *buf, size_t size) {
+    char cmdline[4096];
+    FILE *fp = fopen("/proc/cmdline", "r");
+    if (!fp)
+        return EXIT_FAILURE;
+
+    size_t len = fread(cmdline, 1, sizeof(cmdline) - 1, fp);
+    fclose(fp);
+    cmdline[len] = '\0';
+
+    size_t keylen = strlen(key);
+    char *saveptr;
+    for (char *tok = strtok_r(cmdline, " \t\n", &saveptr); tok != NULL; tok = strtok_r(NULL, " \t\n", &saveptr)) {
+        if (strncmp(tok, key, keylen) != 0 || (tok[keylen] != '=' && tok[keylen] != '\0'))
+            continue;
+        const char *value = tok[keylen] == '=' ? tok + keylen + 1 : "";
+        snprintf(buf, size, "%s", value);
+        return EXIT_SUCCESS;
+    }
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file bench_parsers.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief Benchmark of tty configuration parser and scan of enabled services directory
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "console.h"
+#include "svcscan.h"
+#include "ttyconf.h"
+
+/*! \cond PRIVATE */
+#define BENCH_ENTRIES 10000
+#define BENCH_RUNS 20
+/*! \endcond */
+
+/**
+ * @brief Returns monotonic time
+ * 
+ * @return double time [seconds]
+ */
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Writes tty file with BENCH_ENTRIES lines, mixed ttys, patterns, non-tty entries and comments
+ * 
+ * @param path path to the file
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t writeTtyFile(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return EXIT_FAILURE;
+    for (unsigned int i = 0; i < BENCH_ENTRIES; i++) {
+        switch (i % 4) {
+            case 0:
+                fprintf(f, "tty%u:2345:respawn:/sbin/getty -L 115200 tty%u vt100\n", i, i);
+                break;
+            case 1:
+                fprintf(f, "ttyUSB%u*::respawn:/sbin/getty 115200 $TTY\n", i);
+                break;
+            case 2:
+                fprintf(f, "console%u:1:once:/bin/sh -c echo:%u\n", i, i);
+                break;
+            default:
+                fprintf(f, "# comment %u\n", i);
+        }
+    }
+    return fclose(f) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Fills directory with BENCH_ENTRIES start and stop links of BENCH_ENTRIES / 2 services
+ * 
+ * @param dir directory
+ * @return uint8_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+static uint8_t fillServiceDir(const char *dir) {
+    char path[PATH_MAX];
+    for (unsigned int i = 0; i < BENCH_ENTRIES; i++) {
+        snprintf(path, sizeof(path), "%s/%c%03uservice%u", dir, i % 2 ? 'K' : 'S', 1 + i % 999, i / 2);
+        int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0755);
+        if (fd < 0)
+            return EXIT_FAILURE;
+        close(fd);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Removes the files created by the benchmark
+ * 
+ * @param tty tty file
+ * @param dir services directory
+ */
+static void cleanup(const char *tty, const char *dir) {
+    char path[PATH_MAX];
+    unlink(tty);
+    for (unsigned int i = 0; i < BENCH_ENTRIES; i++) {
+        snprintf(path, sizeof(path), "%s/%c%03uservice%u", dir, i % 2 ? 'K' : 'S', 1 + i % 999, i / 2);
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+int main() {
+    char tty[] = "/tmp/quickinit-bench-tty-XXXXXX";
+    char dir[] = "/tmp/quickinit-bench-svc-XXXXXX";
+
+    console_useStdout();
+    int fd = mkstemp(tty);
+    if (fd < 0 || !mkdtemp(dir)) {
+        perror("bench");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    if (writeTtyFile(tty) != EXIT_SUCCESS || fillServiceDir(dir) != EXIT_SUCCESS) {
+        perror("bench");
+        cleanup(tty, dir);
+        return EXIT_FAILURE;
+    }
+
+    double start = now();
+    size_t entries = 0;
+    for (unsigned int i = 0; i < BENCH_RUNS; i++) {
+        struct tty_config conf = {{NULL, 0, 0}, {NULL, 0, 0}, {NULL}};
+        ttyconf_load(tty, &conf);
+        entries = conf.ttys.count + conf.patterns.count;
+        ttyconf_free(&conf);
+    }
+    printf("tty_load: %u lines, %zu entries, %.3f ms\n", BENCH_ENTRIES, entries, (now() - start) * 1000 / BENCH_RUNS);
+
+    start = now();
+    size_t services = 0;
+    for (unsigned int i = 0; i < BENCH_RUNS; i++) {
+        struct service_node *head = NULL;
+        svcscan_dir(dir, &head);
+        for (services = 0; head != NULL; services++) {
+            struct service_node *next = head->next;
+            free(head);
+            head = next;
+        }
+    }
+    printf("svc_scan: %u links, %zu services, %.3f ms\n", BENCH_ENTRIES, services, (now() - start) * 1000 / BENCH_RUNS);
+
+    cleanup(tty, dir);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file fuzz_svcscan.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief libFuzzer driver for the scan of enabled services directory
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "console.h"
+#include "svcscan.h"
+
+/*! \cond PRIVATE */
+#define FUZZ_MAX_NAMES 64
+/*! \endcond */
+
+static char dir[] = "/tmp/quickinit-fuzz-svc-XXXXXX";
+static int dirfd = -1;
+
+/**
+ * @brief Creates the directory in which inputs are created, messages are discarded
+ * 
+ * @param argc unused
+ * @param argv unused
+ * @return int 0
+ */
+int LLVMFuzzerInitialize(int *argc, char ***argv) {
+    console_useStdout();
+    if (!freopen("/dev/null", "w", stdout))
+        abort();
+    if (!mkdtemp(dir))
+        abort();
+    dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0)
+        abort();
+    return 0;
+}
+
+/**
+ * @brief Parses every line of the input as link name, then creates them and scans the directory
+ * 
+ * @param data input, names separated by newlines
+ * @param size size of the input
+ * @return int 0
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    char names[FUZZ_MAX_NAMES][NAME_MAX + 1];
+    size_t count = 0;
+
+    for (const uint8_t *line = data, *end = data + size; line < end && count < FUZZ_MAX_NAMES;) {
+        const uint8_t *eol = (const uint8_t *)memchr(line, '\n', end - line);
+        size_t len = (eol ? eol : end) - line;
+        if (len > 0 && len <= NAME_MAX && !memchr(line, '/', len) && !memchr(line, '\0', len)) {
+            memcpy(names[count], line, len);
+            names[count][len] = '\0';
+            uint16_t priority_start, priority_stop;
+            svcscan_parseLinkName(names[count], &priority_start, &priority_stop);
+            if (strcmp(names[count], ".") != 0 && strcmp(names[count], "..") != 0) {
+                int fd = openat(dirfd, names[count], O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+                if (fd >= 0) {
+                    close(fd);
+                    count++;
+                }
+            }
+        }
+        line += len + 1;
+    }
+
+    struct service_node *head = NULL;
+    svcscan_dir(dir, &head);
+    while (head != NULL) {
+        struct service_node *next = head->next;
+        free(head);
+        head = next;
+    }
+    for (size_t i = 0; i < count; i++)
+        unlinkat(dirfd, names[i], 0);
+    return 0;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file fuzz_tty.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief libFuzzer driver for the tty configuration parser
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "console.h"
+#include "ttyconf.h"
+
+static char path[] = "/tmp/quickinit-fuzz-tty-XXXXXX";
+static int fd = -1;
+
+/**
+ * @brief Creates the file to which inputs are written, messages are discarded
+ * 
+ * @param argc unused
+ * @param argv unused
+ * @return int 0
+ */
+int LLVMFuzzerInitialize(int *argc, char ***argv) {
+    console_useStdout();
+    if (!freopen("/dev/null", "w", stdout))
+        abort();
+    fd = mkstemp(path);
+    if (fd < 0)
+        abort();
+    unlink(path);  // kept open, parsed through /proc/self/fd
+    return 0;
+}
+
+/**
+ * @brief Parses the input as tty configuration file
+ * 
+ * @param data input
+ * @param size size of the input
+ * @return int 0
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    char fdpath[64];
+    snprintf(fdpath, sizeof(fdpath), "/proc/self/fd/%d", fd);
+    if (ftruncate(fd, 0) < 0 || pwrite(fd, data, size, 0) != (ssize_t)size)
+        return 0;
+
+    struct tty_config conf = {{NULL, 0, 0}, {NULL, 0, 0}, {NULL}};
+    ttyconf_load(fdpath, &conf);
+    ttyconf_free(&conf);
+    return 0;
+}
@@ -0,0 +1,153 @@
+/**
+ * @file test_loop.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief Tests of the timer wheel, its static functions are tested directly
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "loop.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*! \cond PRIVATE */
+#define TEST_TIMERS 1000
+#define TEST_ROUNDS 10
+/*! \endcond */
+
+static uint64_t fired_at[TEST_TIMERS];
+static uint8_t failed = 0;
+
+/**
+ * @brief Records wheel tick at which the timer fired
+ * 
+ * @param data index of the timer
+ */
+static void fired(void *data) {
+    fired_at[(size_t)data] = wheel_now;
+}
+
+/**
+ * @brief Puts timer to the wheel at given tick
+ * 
+ * @param expires wheel tick
+ * @param id index of the timer
+ */
+static void addAt(uint64_t expires, size_t id) {
+    struct loop_timer *t = (struct loop_timer *)malloc(sizeof(struct loop_timer));
+    if (!t)
+        abort();
+    t->expires = expires;
+    t->cb = fired;
+    t->data = (void *)id;
+    wheelInsert(t);
+    timer_count++;
+}
+
+/**
+ * @brief Removes all timers and sets current wheel tick
+ * 
+ * @param now wheel tick
+ */
+static void reset(uint64_t now) {
+    for (uint8_t level = 0; level < LOOP_WHEEL_LEVELS; level++) {
+        for (size_t i = 0; i < LOOP_WHEEL_SIZE; i++) {
+            while (wheel[level][i]) {
+                struct loop_timer *t = wheel[level][i];
+                wheelUnlink(t);
+                free(t);
+            }
+        }
+    }
+    timer_count = 0;
+    wheel_now = now;
+}
+
+/**
+ * @brief Reports failed check
+ * 
+ * @param name name of the test
+ * @param got value
+ * @param expected expected value
+ */
+static void check(const char *name, uint64_t got, uint64_t expected) {
+    if (got == expected)
+        return;
+    printf("FAIL %s: got %llu, expected %llu\n", name, (unsigned long long)got, (unsigned long long)expected);
+    failed = 1;
+}
+
+/**
+ * @brief Timer which wrapped around the current slot of a level mustn't hide earlier timers of the level
+ * 
+ */
+static void testWrappedSlot() {
+    const uint64_t level1 = 1ull << LOOP_WHEEL_BITS;
+    const uint64_t level2 = 1ull << (LOOP_WHEEL_BITS * 2);
+
+    reset(level1 - 1);  // 40.33 s timer lands in the current slot of level 1
+    addAt(wheel_now + level2 - level1 + 1, 0);
+    addAt(wheel_now + 100, 1);
+    check("wrapped level 1", wheelNextExpiry(), wheel_now + 100);
+
+    reset(level2 - 1);  // about 43 min timer lands in the current slot of level 2
+    addAt(wheel_now + (level2 << LOOP_WHEEL_BITS) - level2 + 1, 0);
+    addAt(wheel_now + 5000, 1);
+    check("wrapped level 2", wheelNextExpiry(), wheel_now + 5000);
+
+    reset(level1 - 1);  // only the wrapped timer
+    addAt(wheel_now + level2 - level1 + 1, 0);
+    check("wrapped alone", wheelNextExpiry(), wheel_now + level2 - level1 + 1);
+}
+
+/**
+ * @brief Compares wheel ticks for qsort
+ * 
+ * @param a tick
+ * @param b tick
+ * @return int difference
+ */
+static int compareTicks(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Random timers fire exactly when they expire and the nearest expiry is always the earliest timer
+ * 
+ */
+static void testRandom() {
+    static uint64_t expires[TEST_TIMERS], sorted[TEST_TIMERS];
+    srand(1);
+    for (unsigned int round = 0; round < TEST_ROUNDS && !failed; round++) {
+        reset((uint64_t)rand() << LOOP_WHEEL_BITS);
+        wheel_now += rand() % LOOP_WHEEL_SIZE;  // not aligned, so timers wrap around current slots
+        for (size_t i = 0; i < TEST_TIMERS; i++) {
+            expires[i] = wheel_now + 1 + (uint64_t)rand() % (1ull << (LOOP_WHEEL_BITS * (1 + i % 3)));
+            fired_at[i] = 0;
+            addAt(expires[i], i);
+        }
+        memcpy(sorted, expires, sizeof(expires));
+        qsort(sorted, TEST_TIMERS, sizeof(sorted[0]), compareTicks);
+        for (size_t next = 0; next < TEST_TIMERS && !failed;) {
+            check("next expiry", wheelNextExpiry(), sorted[next]);
+            wheelStep();
+            while (next < TEST_TIMERS && sorted[next] <= wheel_now)
+                next++;
+        }
+        for (size_t i = 0; i < TEST_TIMERS && !failed; i++)
+            check("fired", fired_at[i], expires[i]);
+    }
+}
+
+int main() {
+    testWrappedSlot();
+    testRandom();
+    if (failed)
+        return EXIT_FAILURE;
+    printf("loop: all tests passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file test_svcconf.c
+ * @author bwisn (bwisn_dev (at) outlook (dot) com)
+ * @brief Tests of service configuration shared by template instances
+ * @version 0.1
+ * @date 24-06-2021
+ * 
+ * 
+ */
+#include "svcconf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*! \cond PRIVATE */
+#define TEST_INSTANCES 2
+/*! \endcond */
+
+static uint8_t failed = 0;
+static char dir[] = "/tmp/test_svcconf.XXXXXX";
+
+/**
+ * @brief Reports failed check
+ * 
+ * @param name name of the test
+ * @param got value
+ * @param expected expected value
+ */
+static void check(const char *name, const char *got, const char *expected) {
+    if (got && strcmp(got, expected) == 0)
+        return;
+    printf("FAIL %s: got %s, expected %s\n", name, got ? got : "NULL", expected);
+    failed = 1;
+}
+
+/**
+ * @brief Writes configuration of the service to the test directory
+ * 
+ * @param name name of the service
+ * @param text content of the file
+ */
+static void writeConf(const char *name, const char *text) {
+    char path[SVCCONF_MAX_LINELEN];
+    snprintf(path, sizeof(path), "%s/%s" SVCCONF_SUFFIX, dir, name);
+    FILE *fp = fopen(path, "w");
+    if (!fp || fputs(text, fp) < 0 || fclose(fp) != 0)
+        abort();
+}
+
+/**
+ * @brief Removes configuration of the service from the test directory
+ * 
+ * @param name name of the service
+ */
+static void removeConf(const char *name) {
+    char path[SVCCONF_MAX_LINELEN];
+    snprintf(path, sizeof(path), "%s/%s" SVCCONF_SUFFIX, dir, name);
+    unlink(path);
+}
+
+/**
+ * @brief Instance which overrides health_cmd= mustn't free the command of the template and other instances
+ * 
+ */
+static void testInstanceOverride() {
+    struct service_node tmpl = {.name = "worker@", .instance = -1, .calendar_hour = -1, .calendar_minute = -1};
+    struct service_node instances[TEST_INSTANCES];
+
+    writeConf("worker@", "health_cmd=/bin/check all\n");
+    writeConf("worker@1", "health_cmd=/bin/check one\n");
+    svcconf_load(dir, &tmpl);
+    for (uint8_t i = 0; i < TEST_INSTANCES; i++) {
+        if (svcconf_copy(&instances[i], &tmpl) != EXIT_SUCCESS)
+            abort();
+        snprintf(instances[i].name, sizeof(instances[i].name), "%s%u", tmpl.name, i);
+        instances[i].instance = i;
+    }
+    svcconf_free(&tmpl);
+    for (uint8_t i = 0; i < TEST_INSTANCES; i++)
+        svcconf_load(dir, &instances[i]);
+
+    check("instance without override", instances[0].health_cmd, "/bin/check all");
+    check("instance with override", instances[1].health_cmd, "/bin/check one");
+    for (uint8_t i = 0; i < TEST_INSTANCES; i++)
+        svcconf_free(&instances[i]);
+    removeConf("worker@");
+    removeConf("worker@1");
+}
+
+int main() {
+    if (!mkdtemp(dir))
+        abort();
+    testInstanceOverride();
+    rmdir(dir);
+    if (failed)
+        return EXIT_FAILURE;
+    printf("svcconf: all tests passed\n");
+    return EXIT_SUCCESS;
+}